@@ -0,0 +1,174 @@
+#include "BinTracker.h"
+#include "RowConvert.h"
+
+#include <cmath>
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <iostream>
+
+BinTracker::BinTracker(int rows, int cols, int transformLength, const std::vector<int>& bins)
+    : rows(rows),
+      cols(cols),
+      bins(bins),
+      converter(NULL),
+      samples((size_t)rows * cols),
+      s1(bins.size() * rows),
+      s2(bins.size() * rows)
+{
+    for( size_t b = 0; b < bins.size(); b++ )
+    {
+        double w = 2 * M_PI * bins[b] / transformLength;
+        coefficients.push_back( 2 * cos( w ) );
+        cosines.push_back( cos( w ) );
+        sines.push_back( sin( w ) );
+        rotationRe.push_back( cos( w * (cols - 1) ) );
+        rotationIm.push_back( -sin( w * (cols - 1) ) );
+    }
+}
+
+void BinTracker::Evaluate(const unsigned short* frame, int stride, double* values)
+{
+    LoadSamples( frame, stride );
+    Run( values );
+}
+
+void BinTracker::Evaluate(const float* frame, int stride, double* values)
+{
+    LoadSamples( frame, stride );
+    Run( values );
+}
+
+template<typename T>
+void BinTracker::LoadSamples(const T* frame, int stride)
+{
+    for( int r = 0; r < rows; r++ )
+    {
+        const T* src = frame + (size_t)r * stride;
+        const float* offset = converter ? converter->Offset( r ) : NULL;
+        const float* scale = converter ? converter->Scale( r ) : NULL;
+        if( offset && scale )
+            for( int c = 0; c < cols; c++ )
+                samples[(size_t)c * rows + r] = ( src[c] - offset[c] ) * scale[c];
+        else if( scale )
+            for( int c = 0; c < cols; c++ )
+                samples[(size_t)c * rows + r] = src[c] * scale[c];
+        else
+            for( int c = 0; c < cols; c++ )
+                samples[(size_t)c * rows + r] = src[c];
+    }
+}
+
+void BinTracker::Run(double* values)
+{
+    int nbins = (int)bins.size();
+
+    std::fill( s1.begin(), s1.end(), 0.0 );
+    std::fill( s2.begin(), s2.end(), 0.0 );
+
+    // s[n] = x[n] + 2 cos(w) s[n-1] - s[n-2], every row at once
+    for( int c = 0; c < cols; c++ )
+    {
+        const float* x = &samples[(size_t)c * rows];
+        for( int b = 0; b < nbins; b++ )
+        {
+            double k = coefficients[b];
+            double* p1 = &s1[(size_t)b * rows];
+            double* p2 = &s2[(size_t)b * rows];
+            for( int r = 0; r < rows; r++ )
+            {
+                double s0 = x[r] + k * p1[r] - p2[r];
+                p2[r] = p1[r];
+                p1[r] = s0;
+            }
+        }
+    }
+
+    // X = e^{-jw(N-1)} (s[N-1] - e^{-jw} s[N-2])
+    for( int r = 0; r < rows; r++ )
+    {
+        for( int b = 0; b < nbins; b++ )
+        {
+            double last = s1[(size_t)b * rows + r];
+            double previous = s2[(size_t)b * rows + r];
+            double yRe = last - cosines[b] * previous;
+            double yIm = sines[b] * previous;
+            double* out = values + 2 * ((size_t)r * nbins + b);
+            out[0] = rotationRe[b] * yRe - rotationIm[b] * yIm;
+            out[1] = rotationRe[b] * yIm + rotationIm[b] * yRe;
+        }
+    }
+}
+
+bool BinTracker::ParseBins(const std::string& text, std::vector<int>* bins)
+{
+    std::vector<int> parsed;
+    std::stringstream list( text );
+    std::string item;
+    while( std::getline( list, item, ',' ) )
+    {
+        int first, last;
+        char colon;
+        std::stringstream range( item );
+        if( !(range >> first) )
+            return false;
+        last = first;
+        if( range >> colon && !(colon == ':' && range >> last) )
+            return false;
+        if( first < 0 || last < first )
+            return false;
+        for( int b = first; b <= last; b++ )
+            parsed.push_back( b );
+    }
+    if( parsed.empty() )
+        return false;
+    *bins = parsed;
+    return true;
+}
+
+TimeSeriesWriter::TimeSeriesWriter()
+    : file(NULL),
+      values(0)
+{
+}
+
+TimeSeriesWriter::~TimeSeriesWriter()
+{
+    Close();
+}
+
+bool TimeSeriesWriter::Open(const std::string& path, int rows, int firstRow, const std::vector<int>& bins)
+{
+    Close();
+    file = fopen( path.c_str(), "w" );
+    if( !file )
+    {
+        std::cout << "Cannot open time series " << path << "\n";
+        return false;
+    }
+
+    fprintf( file, "shot,time_s" );
+    for( int r = 0; r < rows; r++ )
+        for( size_t b = 0; b < bins.size(); b++ )
+            fprintf( file, ",row%d_bin%d_re,row%d_bin%d_im", firstRow + r, bins[b], firstRow + r, bins[b] );
+    fprintf( file, "\n" );
+    values = 2 * rows * (int)bins.size();
+    return true;
+}
+
+void TimeSeriesWriter::Close()
+{
+    if( file )
+        fclose( file );
+    file = NULL;
+}
+
+void TimeSeriesWriter::Write(long long number, double seconds, const double* v)
+{
+    if( !file )
+        return;
+    fprintf( file, "%lld,%.6f", number, seconds );
+    for( int i = 0; i < values; i++ )
+        fprintf( file, ",%.9g", v[i] );
+    fprintf( file, "\n" );
+}
@@ -0,0 +1,88 @@
+// Single-frequency tracking for FFTimage.
+//
+// Following one fringe frequency over time does not need the whole row
+// spectrum.  BinTracker evaluates just the chosen bins of every ROI row
+// with the Goertzel recurrence, which costs O(cols) per bin and row
+// instead of a full padded FFT.  The bins are numbered as in the FFT of
+// length transformLength (the zero padding contributes nothing to the
+// sum, so the result equals that FFT bin exactly).
+//
+// The ROI is first transposed into column-major order, so the recurrence
+// for all rows advances together over contiguous memory and the inner
+// loop over rows vectorises.  All bins are run in the same pass over the
+// samples.  The recurrence is kept in double precision; near DC a float
+// Goertzel loses several digits over 1340 samples.
+//
+// TimeSeriesWriter streams the tracked values, one CSV line per shot.
+
+#ifndef BINTRACKER_H
+#define BINTRACKER_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+class RowConverter;
+
+class BinTracker
+{
+public:
+    BinTracker(int rows, int cols, int transformLength, const std::vector<int>& bins);
+
+    // Evaluate every bin of every row of the rows x cols ROI at frame
+    // (stride in pixels).  values gets rows x bins complex numbers,
+    // interleaved re, im, row by row.
+    void Evaluate(const unsigned short* frame, int stride, double* values);
+    // the same for float pixels, such as a binned band
+    void Evaluate(const float* frame, int stride, double* values);
+
+    // correct and window the samples as they are transposed, like the
+    // rows that are transformed (NULL for raw counts)
+    void SetConverter(const RowConverter* converter) { this->converter = converter; }
+
+    int Rows() const { return rows; }
+    const std::vector<int>& Bins() const { return bins; }
+
+    // "12,37" or "10:14" (last inclusive) or a mix, e.g. "3,10:12"
+    static bool ParseBins(const std::string& text, std::vector<int>* bins);
+
+private:
+    // correct, window and transpose the ROI into samples
+    template<typename T>
+    void LoadSamples(const T* frame, int stride);
+    void Run(double* values);
+
+    int rows;
+    int cols;
+    std::vector<int> bins;
+    const RowConverter* converter;
+    std::vector<double> coefficients;   // 2 cos(w) per bin
+    std::vector<double> cosines, sines;
+    std::vector<double> rotationRe, rotationIm; // e^{-jw(cols-1)} per bin
+
+    std::vector<float> samples;         // cols x rows, transposed ROI
+    std::vector<double> s1, s2;         // bins x rows recurrence state
+};
+
+class TimeSeriesWriter
+{
+public:
+    TimeSeriesWriter();
+    ~TimeSeriesWriter();
+
+    // firstRow labels the columns with frame rows
+    bool Open(const std::string& path, int rows, int firstRow, const std::vector<int>& bins);
+    void Close();
+    bool IsOpen() const { return file != NULL; }
+
+    void Write(long long number, double seconds, const double* values);
+
+private:
+    TimeSeriesWriter(const TimeSeriesWriter&);
+    TimeSeriesWriter& operator=(const TimeSeriesWriter&);
+
+    FILE* file;
+    int values;
+};
+
+#endif
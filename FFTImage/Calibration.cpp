@@ -0,0 +1,167 @@
+#include "Calibration.h"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+Calibration::Calibration(const RecordHeader& header)
+    : roi(header),
+      rows(header.rows),
+      cols(header.cols),
+      active(false),
+      offset((size_t)header.rows * header.cols, 0.0f),
+      gain((size_t)header.rows * header.cols, 1.0f)
+{
+}
+
+bool Calibration::ReadMaster(const std::string& path, std::vector<double>* mean, double* exposureMs) const
+{
+    RecordReader reader;
+    if( !reader.Open( path ) )
+        return false;
+
+    const RecordHeader& h = reader.Header();
+    if( h.rows != roi.rows || h.cols != roi.cols
+        || h.roiFirstRow != roi.roiFirstRow || h.roiFirstCol != roi.roiFirstCol
+        || h.sensorX != roi.sensorX || h.sensorY != roi.sensorY
+        || h.xBinning != roi.xBinning || h.yBinning != roi.yBinning || h.binnedRows != roi.binnedRows )
+    {
+        std::cout << path << " was taken with a different ROI or binning\n";
+        return false;
+    }
+    if( !(h.contents & RecordFrames) || reader.Count() == 0 )
+    {
+        std::cout << path << " holds no frames\n";
+        return false;
+    }
+
+    size_t pixels = (size_t)rows * cols;
+    mean->assign( pixels, 0.0 );
+    double shots = 0;
+    for( long long n = 0; n < reader.Count(); n++ )
+    {
+        // statistics records are weighted by the shots that went into them
+        if( h.contents & RecordStatistics )
+        {
+            double weight = reader.Entry( n ).shots;
+            const double* frameMean = reader.Statistics( n );
+            for( size_t i = 0; i < pixels; i++ )
+                (*mean)[i] += weight * frameMean[i];
+            shots += weight;
+        }
+        else if( h.contents & RecordFloatFrames )
+        {
+            const float* frame = reader.FloatFrame( n );
+            for( size_t i = 0; i < pixels; i++ )
+                (*mean)[i] += frame[i];
+            shots += 1;
+        }
+        else
+        {
+            const uint16_t* frame = reader.Frame( n );
+            for( size_t i = 0; i < pixels; i++ )
+                (*mean)[i] += frame[i];
+            shots += 1;
+        }
+    }
+    for( size_t i = 0; i < pixels; i++ )
+        (*mean)[i] /= shots;
+    *exposureMs = h.exposureMs;
+    return true;
+}
+
+bool Calibration::Load(const std::string& biasPath, const std::string& darkPath, const std::string& flatPath)
+{
+    active = false;
+    size_t pixels = (size_t)rows * cols;
+    std::vector<double> bias( pixels, 0.0 ), dark, flat;
+    double biasExposure = 0, darkExposure = 0, flatExposure = 0;
+    std::stringstream used;
+
+    if( !biasPath.empty() )
+    {
+        if( !ReadMaster( biasPath, &bias, &biasExposure ) )
+            return false;
+        used << " bias";
+    }
+    if( !darkPath.empty() )
+    {
+        if( !ReadMaster( darkPath, &dark, &darkExposure ) )
+            return false;
+        used << " dark";
+        if( biasPath.empty() && darkExposure != roi.exposureMs )
+            std::cout << "Dark frame taken at " << darkExposure << " ms, not " << roi.exposureMs
+                      << " ms; without a bias frame it cannot be rescaled\n";
+    }
+    if( !flatPath.empty() )
+    {
+        if( !ReadMaster( flatPath, &flat, &flatExposure ) )
+            return false;
+        used << " flat";
+    }
+    if( used.str().empty() )
+        return false;
+
+    // bias plus dark current accumulated over exposure ms
+    std::vector<double> flatOffset( pixels );
+    for( size_t i = 0; i < pixels; i++ )
+    {
+        double current = 0, current0 = 0;
+        if( !dark.empty() )
+        {
+            if( biasPath.empty() )
+                current = current0 = dark[i];
+            else if( darkExposure > 0 )
+            {
+                current = bias[i] + ( dark[i] - bias[i] ) * roi.exposureMs / darkExposure;
+                current0 = bias[i] + ( dark[i] - bias[i] ) * flatExposure / darkExposure;
+            }
+            else
+                current = current0 = dark[i];
+        }
+        else
+            current = current0 = bias[i];
+        offset[i] = (float)current;
+        flatOffset[i] = current0;
+    }
+
+    if( !flat.empty() )
+    {
+        double total = 0;
+        size_t lit = 0;
+        for( size_t i = 0; i < pixels; i++ )
+        {
+            flat[i] -= flatOffset[i];
+            if( flat[i] > 0 )
+            {
+                total += flat[i];
+                lit++;
+            }
+        }
+        if( lit == 0 )
+        {
+            std::cout << flatPath << " has no signal above the dark level\n";
+            return false;
+        }
+        double level = total / lit;
+        for( size_t i = 0; i < pixels; i++ )
+            gain[i] = flat[i] > 0 ? (float)( level / flat[i] ) : 0.0f;
+    }
+
+    description = used.str();
+    active = true;
+    return true;
+}
+
+void Calibration::PrintStatistics() const
+{
+    if( !active )
+        return;
+    float lowest = *std::min_element( gain.begin(), gain.end() );
+    float highest = *std::max_element( gain.begin(), gain.end() );
+    double level = 0;
+    for( size_t i = 0; i < offset.size(); i++ )
+        level += offset[i];
+    std::cout << "Calibration:" << description << ", mean offset " << level / offset.size()
+              << " counts, gain " << lowest << " to " << highest << std::endl;
+}
@@ -0,0 +1,58 @@
+// Bias, dark and flat-field correction for FFTimage.
+//
+// The master frames are FFTimage recordings of the same ROI, usually the
+// statistics files written by --average (their frame mean is used, over
+// every block), or plain frame recordings (every frame is averaged).
+// From them Calibration works out one offset and one gain per ROI pixel:
+//
+//     offset = bias + (dark - bias) * exposure / darkExposure
+//     gain   = mean(flat - flatOffset) / (flat - flatOffset)
+//
+// where flatOffset is the offset at the flat's own exposure.  Without a
+// bias frame the dark is taken as is, at whatever exposure it was shot.
+// Pixels with no signal in the flat get a gain of 0.
+//
+// RowConverter applies (pixel - offset) * gain while converting a row
+// to float, so the correction rides on the conversion pass
+// the transforms do anyway.  The two float planes only cover the ROI and
+// stay in cache.
+
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include "RecordFile.h"
+
+#include <string>
+#include <vector>
+
+class Calibration
+{
+public:
+    // header describes the ROI the frames will come from
+    explicit Calibration(const RecordHeader& header);
+
+    // Any path may be empty.  Fails, leaving the calibration inactive,
+    // if a master cannot be read or does not match the ROI.
+    bool Load(const std::string& bias, const std::string& dark, const std::string& flat);
+
+    bool Active() const { return active; }
+
+    // the cols offsets and gains of ROI row r
+    const float* Offset(int r) const { return &offset[(size_t)r * cols]; }
+    const float* Gain(int r) const { return &gain[(size_t)r * cols]; }
+
+    void PrintStatistics() const;
+
+private:
+    bool ReadMaster(const std::string& path, std::vector<double>* mean, double* exposureMs) const;
+
+    RecordHeader roi;
+    int rows;
+    int cols;
+    bool active;
+    std::vector<float> offset;
+    std::vector<float> gain;
+    std::string description;
+};
+
+#endif
@@ -0,0 +1,155 @@
+#include "CameraParameters.h"
+
+#include <chrono>
+#include <iostream>
+
+CameraParameters::CameraParameters(PicamHandle camera)
+    : camera(camera),
+      roiKnown(false),
+      sets(0),
+      setsSkipped(0),
+      commits(0),
+      commitsSkipped(0),
+      commitMs(0),
+      lastCommitMs(0)
+{
+}
+
+bool CameraParameters::Known(PicamParameter parameter, double value) const
+{
+    std::map<PicamParameter, double>::const_iterator i = values.find( parameter );
+    return i != values.end() && i->second == value;
+}
+
+// The first time a parameter comes up, what the camera already has is
+// read back, so a value that was never changed is not set either.
+
+PicamError CameraParameters::SetInteger(PicamParameter parameter, piint value)
+{
+    piint current;
+    if( !values.count( parameter )
+        && Picam_GetParameterIntegerValue( camera, parameter, &current ) == PicamError_None )
+        values[parameter] = current;
+    if( Known( parameter, value ) )
+    {
+        setsSkipped++;
+        return PicamError_None;
+    }
+    PicamError error = Picam_SetParameterIntegerValue( camera, parameter, value );
+    if( error == PicamError_None )
+        values[parameter] = value;
+    sets++;
+    return error;
+}
+
+PicamError CameraParameters::SetLargeInteger(PicamParameter parameter, pi64s value)
+{
+    pi64s current;
+    if( !values.count( parameter )
+        && Picam_GetParameterLargeIntegerValue( camera, parameter, &current ) == PicamError_None )
+        values[parameter] = (double)current;
+    if( Known( parameter, (double)value ) )
+    {
+        setsSkipped++;
+        return PicamError_None;
+    }
+    PicamError error = Picam_SetParameterLargeIntegerValue( camera, parameter, value );
+    if( error == PicamError_None )
+        values[parameter] = (double)value;
+    sets++;
+    return error;
+}
+
+PicamError CameraParameters::SetFloatingPoint(PicamParameter parameter, piflt value)
+{
+    piflt current;
+    if( !values.count( parameter )
+        && Picam_GetParameterFloatingPointValue( camera, parameter, &current ) == PicamError_None )
+        values[parameter] = current;
+    if( Known( parameter, value ) )
+    {
+        setsSkipped++;
+        return PicamError_None;
+    }
+    PicamError error = Picam_SetParameterFloatingPointValue( camera, parameter, value );
+    if( error == PicamError_None )
+        values[parameter] = value;
+    sets++;
+    return error;
+}
+
+PicamError CameraParameters::SetRoi(const PicamRoi& region)
+{
+    if( !roiKnown )
+    {
+        const PicamRois* rois;
+        if( Picam_GetParameterRoisValue( camera, PicamParameter_Rois, &rois ) == PicamError_None )
+        {
+            if( rois->roi_count == 1 )
+            {
+                roi = rois->roi_array[0];
+                roiKnown = true;
+            }
+            Picam_DestroyRois( rois );
+        }
+    }
+    if( roiKnown && roi.x == region.x && roi.width == region.width && roi.x_binning == region.x_binning
+        && roi.y == region.y && roi.height == region.height && roi.y_binning == region.y_binning )
+    {
+        setsSkipped++;
+        return PicamError_None;
+    }
+
+    PicamRoi copy = region;
+    PicamRois rois;
+    rois.roi_array = &copy;
+    rois.roi_count = 1;
+    PicamError error = Picam_SetParameterRoisValue( camera, PicamParameter_Rois, &rois );
+    if( error == PicamError_None )
+    {
+        roi = region;
+        roiKnown = true;
+    }
+    sets++;
+    return error;
+}
+
+bool CameraParameters::Commit(bool verboseOutput)
+{
+    // also catches values put back before anything was committed
+    pibln committed = false;
+    Picam_AreParametersCommitted( camera, &committed );
+    if( committed )
+    {
+        commitsSkipped++;
+        if( verboseOutput )
+            std::cout << "Parameters have not changed, not committing\n";
+        return true;
+    }
+
+    const PicamParameter* failed;
+    piint failedCount = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    PicamError error = Picam_CommitParameters( camera, &failed, &failedCount );
+    lastCommitMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    commitMs += lastCommitMs;
+    commits++;
+
+    if( verboseOutput || error != PicamError_None )
+        std::cout << "Commit to hardware took " << lastCommitMs << " ms\n";
+    for( piint i = 0; i < failedCount; i++ )
+    {
+        const pichar* name;
+        Picam_GetEnumerationString( PicamEnumeratedType_Parameter, failed[i], &name );
+        std::cout << "    invalid: " << name << "\n";
+        Picam_DestroyString( name );
+    }
+    Picam_DestroyParameters( failed );
+    return error == PicamError_None && failedCount == 0;
+}
+
+void CameraParameters::PrintStatistics() const
+{
+    std::cout << "Parameters: " << sets << " set, " << setsSkipped << " unchanged; "
+              << commits << " commits (" << commitMs << " ms), " << commitsSkipped << " skipped" << std::endl;
+}
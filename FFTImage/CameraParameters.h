@@ -0,0 +1,54 @@
+// Camera parameters that are only sent when they change.
+//
+// Committing to the PyLoN takes long enough to notice, and the tools used
+// to set and commit the same ADC speed, trigger and shutter settings on
+// every run.  CameraParameters remembers every value it has set (or found
+// already set on the camera) and skips a Set that would change nothing.
+// Commit() asks the camera whether anything is left uncommitted, so a
+// sequence that changes nothing does not commit at all, and changing just
+// the exposure between sequences commits once.  Every commit is timed.
+
+#ifndef CAMERAPARAMETERS_H
+#define CAMERAPARAMETERS_H
+
+#include "picam.h"
+
+#include <map>
+
+class CameraParameters
+{
+public:
+    explicit CameraParameters(PicamHandle camera);
+
+    // Set one value, unless the camera already has it.  Errors are those
+    // of the PICam call.
+    PicamError SetInteger(PicamParameter parameter, piint value);
+    PicamError SetLargeInteger(PicamParameter parameter, pi64s value);
+    PicamError SetFloatingPoint(PicamParameter parameter, piflt value);
+    PicamError SetRoi(const PicamRoi& roi);
+
+    // Commit whatever is uncommitted, printing any parameter the camera
+    // rejects; true if everything is committed afterwards.
+    bool Commit(bool verboseOutput);
+
+    long long Commits() const { return commits; }
+    double LastCommitMs() const { return lastCommitMs; }
+    void PrintStatistics() const;
+
+private:
+    bool Known(PicamParameter parameter, double value) const;
+
+    PicamHandle camera;
+    std::map<PicamParameter, double> values;    // what the camera has been given
+    PicamRoi roi;
+    bool roiKnown;
+
+    long long sets;
+    long long setsSkipped;
+    long long commits;
+    long long commitsSkipped;
+    double commitMs;
+    double lastCommitMs;
+};
+
+#endif
@@ -0,0 +1,365 @@
+// Benchmark of the row transform engines on synthetic frames.
+//
+//     fftbench [--rows 1,10,50,100,400] [--threads 1,2,4] [--frames 200]
+//              [--fft-plan measure] [--fft-wisdom file] [--csv results.csv]
+//
+// Every engine transforms the central rows of 400x1340 16-bit frames that
+// look like the PyLoN's (bias, a band of fringes, noise), padded to
+// getOptimalDFTSize(1340) columns as FFTimage does:
+//
+//     opencv-orig   what FFTimage did before any of these engines:
+//                   copyMakeBorder to getOptimalDFTSize rows and columns,
+//                   convertTo, merge with a zero plane, dft(DFT_ROWS) and
+//                   split, allocating as it goes, with
+//                   cv::setNumThreads(threads)
+//     opencv        RowConverter + dft(DFT_ROWS) + split, likewise
+//     fftw-c2c      RowFFT: a batched complex plan per thread's slice of rows
+//     fftw-r2c      RowFFT: a batched real-to-complex plan per slice
+//     fftw-r2c-row  one r2c plan run row by row, what batching saves
+//                   (single thread only)
+//
+// opencv, fftw-c2c and fftw-r2c go through TransformRows(), the function
+// FFTimage calls, including the final split into Re and Im planes, and
+// convert with the fastest kernel this CPU has.  For every ROI height and
+// thread count the benchmark prints frames per second, nanoseconds per
+// row, the speedup over opencv-orig at the same height and thread count,
+// and the largest deviation of the spectrum from OpenCV's, relative to the
+// largest OpenCV bin.
+//
+// The conversion into padded complex rows is also timed on its own, per
+// ROI height on one thread: convert-opencv is copyMakeBorder + convertTo
+// + merge, the three passes it replaced, and convert-<kernel> is
+// RowConverter with each kernel the CPU runs (avx512, avx2, scalar),
+// checked against and compared with convert-opencv.
+
+#include "RowFFT.h"
+#include "RowTransform.h"
+#include "FFTWorkspace.h"
+#include "RowConvert.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <vector>
+#include <boost/program_options.hpp>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+using namespace cv;
+namespace po = boost::program_options;
+
+#define BENCH_ROWS          400
+#define BENCH_COLS          1340
+#define BENCH_FRAMES        8       // distinct synthetic frames, cycled
+#define BENCH_WARMUP        10
+
+typedef std::chrono::steady_clock Clock;
+
+struct Result
+{
+    std::string engine;
+    int rows;
+    int threads;
+    double framesPerSecond;
+    double nsPerRow;
+    double speedup;
+    double error;
+};
+
+static bool ParseList(const std::string& text, std::vector<int>* values)
+{
+    std::stringstream list( text );
+    std::string item;
+    values->clear();
+    while( std::getline( list, item, ',' ) )
+    {
+        int value = atoi( item.c_str() );
+        if( value < 1 )
+            return false;
+        values->push_back( value );
+    }
+    return !values->empty();
+}
+
+// Bias, a band of fringes across the middle rows and Gaussian noise, like
+// the simulated camera.
+static void MakeFrames(std::vector<Mat>& frames)
+{
+    std::mt19937 random( 12345 );
+    std::normal_distribution<float> noise( 0.0f, 6.0f );
+    for( int f = 0; f < BENCH_FRAMES; f++ )
+    {
+        Mat frame( BENCH_ROWS, BENCH_COLS, CV_16U );
+        for( int y = 0; y < BENCH_ROWS; y++ )
+        {
+            double d = ( y - BENCH_ROWS / 2 ) / 25.0;
+            double envelope = 30.0 + 12000.0 * exp( -0.5 * d * d );
+            unsigned short* row = frame.ptr<unsigned short>(y);
+            for( int x = 0; x < BENCH_COLS; x++ )
+            {
+                double fringe = 1.0 + 0.6 * cos( 2 * M_PI * x / 16.0 + 0.07 * f );
+                double value = 600.0 + envelope * fringe + noise( random );
+                row[x] = value <= 0 ? 0 : value >= 65535 ? 65535 : (unsigned short)value;
+            }
+        }
+        frames.push_back( frame );
+    }
+}
+
+// Seconds per frame for transform(roi) over the frames, after a warm-up.
+template <typename Transform>
+static double TimeFrames(const std::vector<Mat>& rois, int frames, Transform transform)
+{
+    for( int f = 0; f < BENCH_WARMUP; f++ )
+        transform( rois[f % rois.size()] );
+    Clock::time_point start = Clock::now();
+    for( int f = 0; f < frames; f++ )
+        transform( rois[f % rois.size()] );
+    return std::chrono::duration<double>( Clock::now() - start ).count() / frames;
+}
+
+// Largest |Re| deviation from the reference over the bins both have.
+static double Deviation(const Mat& real, const Mat& reference)
+{
+    int cols = std::min( real.cols, reference.cols );
+    double largest = 0, deviation = 0;
+    for( int r = 0; r < reference.rows; r++ )
+    {
+        const float* a = real.ptr<float>(r);
+        const float* b = reference.ptr<float>(r);
+        for( int c = 0; c < cols; c++ )
+        {
+            largest = std::max( largest, (double)fabs( b[c] ) );
+            deviation = std::max( deviation, (double)fabs( a[c] - b[c] ) );
+        }
+    }
+    return largest > 0 ? deviation / largest : 0;
+}
+
+// baselineSeconds is the time per frame the speedup is relative to
+static Result Measure(const std::string& engine, int rows, int threads, double secondsPerFrame,
+                      double baselineSeconds, const Mat& real, const Mat& reference)
+{
+    Result result;
+    result.engine = engine;
+    result.rows = rows;
+    result.threads = threads;
+    result.framesPerSecond = 1.0 / secondsPerFrame;
+    result.nsPerRow = secondsPerFrame * 1e9 / rows;
+    result.speedup = baselineSeconds / secondsPerFrame;
+    result.error = Deviation( real, reference );
+    std::ios state( NULL );
+    state.copyfmt( std::cout );
+    std::cout << std::left << std::setw(14) << engine << std::right
+              << std::setw(6) << rows << std::setw(9) << threads
+              << std::fixed << std::setprecision(1)
+              << std::setw(12) << result.framesPerSecond << std::setw(12) << result.nsPerRow
+              << std::setprecision(2) << std::setw(9) << result.speedup
+              << std::scientific << std::setprecision(1) << std::setw(12) << result.error
+              << std::endl;
+    std::cout.copyfmt( state );
+    return result;
+}
+
+int main(int ac, char* av[])
+{
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "produce help message")
+        ("rows", po::value<std::string>()->default_value("1,10,50,100,400"), "ROI heights to transform, comma separated")
+        ("threads", po::value<std::string>()->default_value("1,2,4"), "thread counts to try, comma separated")
+        ("frames", po::value<int>()->default_value(200), "frames timed per engine and setting")
+        ("fft-plan", po::value<std::string>()->default_value("measure"), "FFTW planning rigor: estimate, measure, patient or exhaustive")
+        ("fft-wisdom", po::value<std::string>()->default_value(""), "file to load and save FFTW wisdom")
+        ("csv", po::value<std::string>()->default_value(""), "also write the results to this CSV file")
+    ;
+    po::variables_map vm;
+    po::store( po::parse_command_line( ac, av, desc ), vm );
+    po::notify( vm );
+    if( vm.count( "help" ) )
+    {
+        std::cout << desc << "\n";
+        return 1;
+    }
+
+    std::vector<int> heights, threadCounts;
+    if( !ParseList( vm["rows"].as<std::string>(), &heights )
+        || !ParseList( vm["threads"].as<std::string>(), &threadCounts ) )
+    {
+        std::cout << "Cannot parse --rows or --threads\n";
+        return 1;
+    }
+    int frames = std::max( 1, vm["frames"].as<int>() );
+    unsigned planFlags = FFTW_MEASURE;
+    if( !RowFFT::ParsePlanFlags( vm["fft-plan"].as<std::string>(), &planFlags ) )
+    {
+        std::cout << "Unknown --fft-plan " << vm["fft-plan"].as<std::string>() << "\n";
+        return 1;
+    }
+    std::string wisdomFile = vm["fft-wisdom"].as<std::string>();
+    RowFFT::ImportWisdom( wisdomFile );
+
+    std::vector<Mat> images;
+    MakeFrames( images );
+    const int cols = BENCH_COLS;
+    const int paddedCols = getOptimalDFTSize( cols );
+    const int halfCols = paddedCols / 2 + 1;
+    std::cout << BENCH_ROWS << "x" << cols << " frames, rows padded to " << paddedCols
+              << ", " << frames << " frames per measurement, converting with "
+              << RowConverter( 1, cols ).Kernel() << "\n\n"
+              << "engine          rows  threads    frames/s      ns/row  vs.orig   rel.error\n";
+
+    std::vector<Result> results;
+    for( size_t h = 0; h < heights.size(); h++ )
+    {
+        int rows = std::min( heights[h], BENCH_ROWS );
+        int first = ( BENCH_ROWS - rows ) / 2;
+        std::vector<Mat> rois;
+        for( size_t f = 0; f < images.size(); f++ )
+            rois.push_back( images[f]( Range( first, first + rows ), Range::all() ) );
+
+        // OpenCV's single-threaded spectrum of the first frame is what
+        // every engine is checked against
+        RowConverter converter( rows, cols );
+        FFTWorkspace referenceSpace;
+        referenceSpace.Preallocate( &referenceSpace.complexI, rows, paddedCols, CV_32FC2 );
+        Mat referenceSpectrum[2];
+        setNumThreads( 1 );
+        TransformRows( rois[0], NULL, converter, referenceSpace, referenceSpectrum, NULL );
+        Mat reference = referenceSpectrum[0];
+
+        // conversion alone: OpenCV's three passes, then each kernel
+        setNumThreads( 1 );
+        Mat padded( rows, paddedCols, CV_16U ), planes[2], complexI( rows, paddedCols, CV_32FC2 );
+        planes[0].create( rows, paddedCols, CV_32F );
+        planes[1] = Mat::zeros( rows, paddedCols, CV_32F );
+        double seconds = TimeFrames( rois, frames, [&](const Mat& roi) {
+            copyMakeBorder( roi, padded, 0, 0, 0, paddedCols - cols, BORDER_CONSTANT | BORDER_ISOLATED, Scalar::all(0) );
+            padded.convertTo( planes[0], CV_32F );
+            merge( planes, 2, complexI );
+        });
+        copyMakeBorder( rois[0], padded, 0, 0, 0, paddedCols - cols, BORDER_CONSTANT | BORDER_ISOLATED, Scalar::all(0) );
+        padded.convertTo( planes[0], CV_32F );
+        merge( planes, 2, complexI );
+        Mat converted = complexI.reshape( 1 ).clone();
+        double convertSeconds = seconds;
+        results.push_back( Measure( "convert-opencv", rows, 1, seconds, convertSeconds, converted, converted ) );
+        std::vector<std::string> kernels = RowConverter::Kernels();
+        for( size_t k = 0; k < kernels.size(); k++ )
+        {
+            RowConverter kernel( rows, cols );
+            kernel.UseKernel( kernels[k] );
+            auto convert = [&](const Mat& roi) {
+                for( int r = 0; r < rows; r++ )
+                    kernel.ConvertComplexRow( r, roi.ptr<unsigned short>(r), complexI.ptr<float>(r), paddedCols );
+            };
+            seconds = TimeFrames( rois, frames, convert );
+            convert( rois[0] );
+            results.push_back( Measure( "convert-" + kernels[k], rows, 1, seconds, convertSeconds,
+                                        complexI.reshape( 1 ), converted ) );
+        }
+
+        for( size_t t = 0; t < threadCounts.size(); t++ )
+        {
+            int threads = threadCounts[t];
+
+            // FFTimage's original sequence, every Mat made afresh per frame
+            Mat originalSpectrum;
+            auto original = [&](const Mat& roi) {
+                Mat padded;
+                int m = getOptimalDFTSize( roi.rows );
+                int n = getOptimalDFTSize( roi.cols );
+                copyMakeBorder( roi, padded, 0, m - roi.rows, 0, n - roi.cols, BORDER_CONSTANT, Scalar::all(0) );
+                Mat planes[] = { Mat_<float>(padded), Mat::zeros( padded.size(), CV_32F ) };
+                Mat complexI;
+                merge( planes, 2, complexI );
+                dft( complexI, complexI, DFT_ROWS );
+                split( complexI, planes );
+                originalSpectrum = planes[0];
+            };
+            setNumThreads( threads );
+            double baseline = TimeFrames( rois, frames, original );
+            original( rois[0] );
+            results.push_back( Measure( "opencv-orig", rows, threads, baseline, baseline,
+                                        originalSpectrum( Range( 0, rows ), Range::all() ), reference ) );
+
+            FFTWorkspace opencvSpace;
+            opencvSpace.Preallocate( &opencvSpace.complexI, rows, paddedCols, CV_32FC2 );
+            Mat opencvSpectrum[2];
+            seconds = TimeFrames( rois, frames, [&](const Mat& roi) {
+                TransformRows( roi, NULL, converter, opencvSpace, opencvSpectrum, NULL );
+            });
+            TransformRows( rois[0], NULL, converter, opencvSpace, opencvSpectrum, NULL );
+            results.push_back( Measure( "opencv", rows, threads, seconds, baseline, opencvSpectrum[0], reference ) );
+            setNumThreads( 1 );
+
+            for( int half = 0; half < 2; half++ )
+            {
+                RowFFT rowFFT( rows, cols, paddedCols, planFlags, half != 0, threads );
+                FFTWorkspace space;
+                Mat fftwSpectrum[2];
+                seconds = TimeFrames( rois, frames, [&](const Mat& roi) {
+                    TransformRows( roi, &rowFFT, converter, space, fftwSpectrum, NULL );
+                });
+                TransformRows( rois[0], &rowFFT, converter, space, fftwSpectrum, NULL );
+                results.push_back( Measure( half ? "fftw-r2c" : "fftw-c2c", rows, rowFFT.Threads(), seconds,
+                                            baseline, fftwSpectrum[0], reference ) );
+            }
+
+            if( threads != 1 )
+                continue;
+
+            // the same transform, one fftwf_execute per row
+            float* in = (float*) fftwf_malloc( sizeof(float) * rows * paddedCols );
+            fftwf_complex* out = (fftwf_complex*) fftwf_malloc( sizeof(fftwf_complex) * rows * halfCols );
+            // the plan runs on every row's arrays, not the ones it was made
+            // with, and the output rows are halfCols complex values apart
+            // (odd for any even length that is a multiple of four), so it
+            // must not count on the alignment of in and out
+            fftwf_plan plan = fftwf_plan_dft_r2c_1d( paddedCols, in, out, planFlags | FFTW_UNALIGNED );
+            std::fill( in, in + (size_t)rows * paddedCols, 0.0f );
+            Mat output( rows, halfCols, CV_32FC2, (void*)out );
+            Mat spectrum[2];
+            spectrum[0].create( rows, halfCols, CV_32F );
+            spectrum[1].create( rows, halfCols, CV_32F );
+            auto perRow = [&](const Mat& roi) {
+                for( int r = 0; r < rows; r++ )
+                {
+                    const unsigned short* src = roi.ptr<unsigned short>(r);
+                    float* dst = in + (size_t)r * paddedCols;
+                    for( int c = 0; c < cols; c++ )
+                        dst[c] = src[c];
+                    fftwf_execute_dft_r2c( plan, dst, out + (size_t)r * halfCols );
+                }
+                split( output, spectrum );
+            };
+            seconds = TimeFrames( rois, frames, perRow );
+            perRow( rois[0] );
+            results.push_back( Measure( "fftw-r2c-row", rows, 1, seconds, baseline, spectrum[0], reference ) );
+            fftwf_destroy_plan( plan );
+            fftwf_free( in );
+            fftwf_free( out );
+        }
+    }
+    RowFFT::ExportWisdom( wisdomFile );
+
+    std::string csvFile = vm["csv"].as<std::string>();
+    if( !csvFile.empty() )
+    {
+        std::ofstream csv( csvFile.c_str() );
+        csv << "engine,rows,threads,frames_per_second,ns_per_row,speedup,relative_error\n";
+        for( size_t r = 0; r < results.size(); r++ )
+            csv << results[r].engine << "," << results[r].rows << "," << results[r].threads << ","
+                << results[r].framesPerSecond << "," << results[r].nsPerRow << "," << results[r].speedup << "," << results[r].error << "\n";
+        if( csv )
+            std::cout << "\nResults written to " << csvFile << "\n";
+        else
+            std::cout << "\nCannot write " << csvFile << "\n";
+    }
+    return 0;
+}
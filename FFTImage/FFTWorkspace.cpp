@@ -0,0 +1,59 @@
+#include "FFTWorkspace.h"
+
+#include <cstdlib>
+#include <new>
+#include <iostream>
+
+#define BUFFER_ALIGNMENT  64
+
+FFTWorkspace::FFTWorkspace()
+    : bytes(0),
+      reallocations(0),
+      frames(0)
+{
+}
+
+FFTWorkspace::~FFTWorkspace()
+{
+    // the headers may already be gone (a pipeline slot outlives nothing),
+    // so only the memory is freed; a header still pointing into it is
+    // never used again
+    for( size_t b = 0; b < blocks.size(); b++ )
+        free( blocks[b] );
+}
+
+void FFTWorkspace::Preallocate(cv::Mat* m, int rows, int cols, int type)
+{
+    size_t size = (size_t)rows * cols * CV_ELEM_SIZE(type);
+    void* memory = NULL;
+    if( posix_memalign( &memory, BUFFER_ALIGNMENT, size ? size : BUFFER_ALIGNMENT ) != 0 )
+        throw std::bad_alloc();
+    blocks.push_back( memory );
+    bytes += size;
+
+    *m = cv::Mat( rows, cols, type, memory );
+    buffers.push_back( m );
+    expected.push_back( m->data );
+}
+
+int FFTWorkspace::CheckReallocations()
+{
+    int count = 0;
+    for( size_t i = 0; i < buffers.size(); i++ )
+    {
+        if( buffers[i]->data != expected[i] )
+        {
+            expected[i] = buffers[i]->data;
+            count++;
+        }
+    }
+    reallocations += count;
+    frames++;
+    return count;
+}
+
+void FFTWorkspace::PrintStatistics(const char* name) const
+{
+    std::cout << name << ": " << buffers.size() << " buffer(s), " << bytes / 1024 << " kB, "
+              << reallocations << " reallocation(s) in " << frames << " frames" << std::endl;
+}
@@ -0,0 +1,52 @@
+// Preallocated buffers for the per-frame transform in FFTimage.
+//
+// Every matrix the shot loop writes into is set aside with Preallocate()
+// before the first shot: each processing thread's OpenCV input buffer,
+// and the spectrum, binned row and tracked bins of every shot in flight
+// (the single shot of the plain loop, or each pipeline slot).  OpenCV
+// functions only reallocate an output when its size or type does not
+// match, and when they do the data pointer changes; CheckReallocations()
+// compares the pointers after each frame, on the thread that just wrote
+// them, so the zero-allocation claim can be verified rather than assumed.
+
+#ifndef FFTWORKSPACE_H
+#define FFTWORKSPACE_H
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+class FFTWorkspace
+{
+public:
+    FFTWorkspace();
+    ~FFTWorkspace();
+
+    cv::Mat complexI;           // CV_32FC2 rows x paddedCols, the OpenCV dft() input and output
+
+    // Point m at a rows x cols matrix of type, in 64-byte aligned memory
+    // allocated now, and check it from then on.
+    void Preallocate(cv::Mat* m, int rows, int cols, int type);
+
+    // Number of buffers found reallocated since the last call (they are
+    // re-registered, so each reallocation is counted once).
+    int CheckReallocations();
+
+    long long Reallocations() const { return reallocations; }
+    long long Frames() const { return frames; }
+    size_t Bytes() const { return bytes; }
+    void PrintStatistics(const char* name) const;
+
+private:
+    FFTWorkspace(const FFTWorkspace&);
+    FFTWorkspace& operator=(const FFTWorkspace&);
+
+    std::vector<void*> blocks;
+    size_t bytes;
+
+    std::vector<cv::Mat*> buffers;
+    std::vector<const unsigned char*> expected;
+    long long reallocations;
+    long long frames;
+};
+
+#endif
@@ -4,13 +4,33 @@
 //1 frame of data each time the function is called, looping
 //through 5 times.
 
-// TODO: add command line flags to specify saving full FFT or an ROI
-
 #define NUM_FRAMES  5
 #define NO_TIMEOUT  -1
 
 #include "stdio.h"
 #include "picam.h"
+#include "FrameStream.h"
+#include "RowFFT.h"
+#include "RowTransform.h"
+#include "SensorGeometry.h"
+#include "FFTWorkspace.h"
+#include "Pipeline.h"
+#include "RecordFile.h"
+#include "BinTracker.h"
+#include "ShotAccumulator.h"
+#include "Calibration.h"
+#include "PixelFilter.h"
+#include "LivePreview.h"
+#include "CameraParameters.h"
+#include "ReadoutBatch.h"
+#include "ReadoutMetadata.h"
+#include "StageProfile.h"
+#include "RowBinner.h"
+#include "RowConvert.h"
+#ifdef HAVE_HDF5
+#include "Hdf5Writer.h"
+#endif
+#include <fstream>
 #include <boost/program_options.hpp>
 #include <opencv2/opencv.hpp>
 #include "opencv2/core/core.hpp"
@@ -43,19 +63,126 @@ void PrintError (PicamError error)
     }
 }
 
-Mat CollectShot(PicamHandle camera, PicamAvailableData data, PicamAcquisitionErrorsMask errors, bool verboseOutput)
+// Parse "first:last" in sensor pixels (last exclusive, like cv::Range)
+// and map it onto a frame read out from offset with the given binning.
+// An empty string means the whole frame.  False if malformed or outside
+// the frame.
+bool ParseRange(const std::string& text, int offset, int binning, int size, Range* range)
 {
-	if (verboseOutput) std::cout << "Collecting 1 frame\n\n";
-    if( Picam_Acquire( camera, 1, NO_TIMEOUT, &data, &errors ) )
-        printf( "Error: Camera only collected %d frames\n", (piint)data.readout_count );
-    else
-    {
-    	std::cout << "One frame collected\n";
+    int first, last;
+    if (!ParseFrameRange(text.c_str(), offset, binning, size, &first, &last)) {
+        std::cout << "Cannot use range \"" << text << "\"\n";
+        return false;
     }
-    
-    Mat image = Mat(400,1340, CV_16U, data.initial_readout).clone();
+    *range = Range(first, last);
+    return true;
+}
 
-    return image;
+// The next frame of the batch, acquiring up to batchSize more readouts in
+// one Picam_Acquire once the batch is used up.  Empty if nothing came.
+Mat CollectShot(PicamHandle camera, ReadoutBatch& batch, int& next, int batchSize, const FrameGeometry& geometry, bool verboseOutput)
+{
+	if (next >= batch.Count()) {
+		if (verboseOutput) std::cout << "Collecting " << batchSize << " frame(s)\n\n";
+		if (batch.Acquire(camera, batchSize, NO_TIMEOUT) && verboseOutput)
+			std::cout << batch.Count() << " frame(s) collected\n";
+		next = 0;
+		if (batch.Count() == 0)
+			return Mat();
+	}
+
+    // no copy: the readout stays valid until the next Picam_Acquire
+    return Mat(geometry.rows, geometry.cols, CV_16U, (void*)batch.Frame(next++));
+}
+
+// Where processed shots go.
+struct Outputs
+{
+    RecordWriter recorder;
+    long long recordShots;          // record shots numbered below this, 0 = all
+#ifdef HAVE_HDF5
+    Hdf5Writer* hdf5;               // every shot, if set
+#endif
+    TimeSeriesWriter series;        // tracked bins, every shot
+    LivePreview* preview;           // latest frames on screen, if set
+    ShotAccumulator* average;       // running statistics, if set
+    RecordWriter averageFile;       // one statistics record per block
+    long long averageShots;         // shots per block
+    long long averageBlocks;
+    std::chrono::steady_clock::time_point started;
+    StageTimes* times;              // stage times of the thread writing, if profiling
+    bool snapshotWritten;           // datafile.png, from the first shot to arrive
+};
+
+// Display a processed shot, record it and, for the first one to get
+// here, save a picture of the ROI.
+void OutputShot(const Shot& shot, const Mat& image, Range roiRows, Range roiCols,
+                Outputs& outputs, bool verboseOutput)
+{
+    long long i = shot.number;
+    Mat roi = shot.binned.empty() ? image(roiRows, roiCols) : shot.binned;
+    Mat realI = shot.spectrum[0];   // empty when only tracking bins
+    Mat imagI = shot.spectrum[1];
+
+    //magI += Scalar::all(1);                    // switch to logarithmic scale
+    //log(magI, magI);
+
+    StageTimes::Clock::time_point mark = StageTimes::Clock::now();
+    if (outputs.preview) {
+    	outputs.preview->Offer(image);    // never waits for the display
+    	MarkStage(outputs.times, StagePreview, mark);
+    }
+    // the binned band is a float row, a plain ROI the raw counts
+    bool binned = roi.depth() == CV_32F;
+    if (outputs.recorder.IsOpen() && (outputs.recordShots == 0 || i < outputs.recordShots)) {
+    	if (binned)
+    		outputs.recorder.Write(i, shot.timestamp, roi.ptr<float>(0), roi.step1(),
+    		                       realI.ptr<float>(0), imagI.ptr<float>(0), realI.step1());
+    	else
+    		outputs.recorder.Write(i, shot.timestamp,
+    		                       roi.ptr<uint16_t>(0), roi.step1(),      // the spectra only cover the ROI
+    		                       realI.ptr<float>(0), imagI.ptr<float>(0), realI.step1());
+    	MarkStage(outputs.times, StageRecord, mark);
+    }
+#ifdef HAVE_HDF5
+    if (outputs.hdf5) {
+    	if (binned)
+    		outputs.hdf5->Write(i, shot.timestamp, roi.ptr<float>(0), roi.step1(),
+    		                    realI.ptr<float>(0), imagI.ptr<float>(0), realI.step1());
+    	else
+    		outputs.hdf5->Write(i, shot.timestamp, roi.ptr<uint16_t>(0), roi.step1(),
+    		                    realI.ptr<float>(0), imagI.ptr<float>(0), realI.step1());
+    	MarkStage(outputs.times, StageHdf5, mark);
+    }
+#endif
+    if (outputs.average) {
+    	if (binned)
+    		outputs.average->Add(roi.ptr<float>(0), roi.step1(),
+    		                     realI.ptr<float>(0), imagI.ptr<float>(0), realI.step1());
+    	else
+    		outputs.average->Add(roi.ptr<uint16_t>(0), roi.step1(),
+    		                     realI.ptr<float>(0), imagI.ptr<float>(0), realI.step1());
+    	if (outputs.average->Shots() == outputs.averageShots) {
+    		outputs.averageFile.WriteStatistics(outputs.averageBlocks++, shot.timestamp,
+    		                                    outputs.average->Shots(), outputs.average->Planes());
+    		outputs.average->Reset();
+    	}
+    	MarkStage(outputs.times, StageAverage, mark);
+    }
+    if (outputs.series.IsOpen()) {
+    	outputs.series.Write(i, std::chrono::duration<double>(shot.timestamp - outputs.started).count(),
+    	                     shot.tracked.ptr<double>(0));
+    	MarkStage(outputs.times, StageSeries, mark);
+    }
+    if (!outputs.snapshotWritten) {
+    	outputs.snapshotWritten = true;
+    	Mat picture = roi;
+    	if (binned)
+    		roi.convertTo(picture, CV_16U);     // PNG takes whole counts
+    	imwrite("datafile.png", picture);
+    }
+    if (outputs.times)
+    	outputs.times->Mark(StageLatency, shot.timestamp);
 }
 
 PicamHandle InitializeCamera (PicamCameraID id, PicamAvailableData data, PicamAcquisitionErrorsMask errors, bool verboseOutput)
@@ -92,16 +219,19 @@ PicamHandle InitializeCamera (PicamCameraID id, PicamAvailableData data, PicamAc
     return camera;
 }
 
-void ConfigureCamera (PicamHandle camera, bool verboseOutput)
+// Only settings that differ from what the camera already has are sent,
+// and the commit is skipped when nothing changed.
+// False if the camera refused to commit the parameters.
+bool ConfigureCamera (CameraParameters& parameters, const PicamRoi& roi, bool verboseOutput)
 {
 
-    if (verboseOutput)
+    if (verboseOutput) {
     	std::cout << "Configuring camera...\n";
     	std::cout << "Set ADC rate to 4 MHz: ";
+    }
     
     PicamError error;
-    error = Picam_SetParameterFloatingPointValue(
-                camera,
+    error = parameters.SetFloatingPoint(
                 PicamParameter_AdcSpeed,
                 4.0 );
     PrintError( error );
@@ -112,8 +242,7 @@ void ConfigureCamera (PicamHandle camera, bool verboseOutput)
     // PicamTriggerResponse TriggerResponse =  PicamTriggerResponse_ExposeDuringTriggerPulse; 
     PicamTriggerDetermination TriggerDetermination = PicamTriggerDetermination_RisingEdge;
 
-    // error = Picam_SetParameterIntegerValue(
-    // 			camera,
+    // error = parameters.SetInteger(
     // 			PicamParameter_TriggerResponse,
     // 			TriggerResponse );
     // PrintError( error );
@@ -121,53 +250,31 @@ void ConfigureCamera (PicamHandle camera, bool verboseOutput)
     if (verboseOutput)
     	std::cout << "Set trigger determination: ";
 
-    error = Picam_SetParameterIntegerValue(
-    			camera,
+    error = parameters.SetInteger(
     			PicamParameter_TriggerDetermination,
     			TriggerDetermination );
     PrintError( error );
 
-    
-    pibln committed;
-    Picam_AreParametersCommitted( camera, &committed );
-    if( committed )
-        if (verboseOutput)
-    		std::cout << "Parameters have not changed" << std::endl;
-    else
-        if (verboseOutput)
-    		std::cout << "Parameters have been modified" << std::endl;
-
-    // apply changes to hardware
     if (verboseOutput)
-    	std::cout << "Commit to hardware: ";
-    const PicamParameter* failed_parameters;
-    piint failed_parameters_count;
-    error = 
-        Picam_CommitParameters(
-            camera,
-            &failed_parameters,
-            &failed_parameters_count );
+    	std::cout << "Set sensor ROI to " << roi.width << "x" << roi.height
+    	          << " at (" << roi.x << "," << roi.y << "), binning "
+    	          << roi.x_binning << "x" << roi.y_binning << ": ";
+    error = parameters.SetRoi( roi );
     PrintError( error );
 
+    // each readout then says when it was exposed and which frame it is,
+    // so dropped frames show up as gaps
     if (verboseOutput)
-    	std::cout << "Testing for invalid params\n";
-    if( failed_parameters_count > 0 )
-    {
-        if (verboseOutput)
-    		std::cout << "The following params are invalid:" << std::endl;
-        for( piint i = 0; i < failed_parameters_count; ++i )
-        {
-            std::cout << "    ";
-            PrintEnumString(
-                PicamEnumeratedType_Parameter,
-                failed_parameters[i] );
-            std::cout << std::endl;
-        }
-    }
-    if (verboseOutput)
-    	std::cout << "Cleaning up resources\n";
+    	std::cout << "Turn on time stamps and frame tracking: ";
+    error = ReadoutMetadata::Enable( parameters );
+    PrintError( error );
 
-    Picam_DestroyParameters( failed_parameters );
+    // apply changes to hardware, if there are any
+    if (!parameters.Commit( verboseOutput )) {
+    	std::cout << "Commit to hardware failed\n";
+    	return false;
+    }
+    return true;
 }
 
 int main(int ac, char* av[])
@@ -177,10 +284,63 @@ int main(int ac, char* av[])
 	desc.add_options()
 	    ("help", "produce help message")
 	    ("verbose", "explain each step")
+	    ("stream", "acquire continuously into a circular buffer instead of one Picam_Acquire per shot")
+	    ("pipeline", "acquire, process and write on separate threads (implies --stream)")
+	    ("pipeline-slots", po::value<int>()->default_value(16), "shots in flight between the pipeline stages")
+	    ("process-threads", po::value<int>()->default_value(2), "pipeline threads transforming shots in parallel")
+	    ("backpressure", po::value<std::string>()->default_value("block"), "when every pipeline slot is busy: block or drop-oldest")
+	    ("batch", po::value<int>()->default_value(1), "without --stream, readouts collected per Picam_Acquire call")
+	    ("circular-readouts", po::value<int>()->default_value(64), "readouts in the PICam circular buffer (--stream)")
+	    ("frame-report", po::value<double>()->default_value(5), "seconds between live dropped-frame and frame-rate reports (0 = only at the end)")
+	    ("fft-engine", po::value<std::string>()->default_value("fftw"), "row transform: fftw or opencv")
+	    ("fft-plan", po::value<std::string>()->default_value("measure"), "FFTW planning rigor: estimate, measure, patient or exhaustive")
+	    ("fft-wisdom", po::value<std::string>()->default_value(""), "file to load and save FFTW wisdom")
+	    ("fft-full-spectrum", "FFTW: full complex transform instead of the r2c half spectrum")
+	    ("fft-threads", po::value<int>()->default_value(1), "threads sharing the rows of each FFTW transform, for each processing thread (0 = the cores shared between the processing threads)")
+	    ("fft-window", po::value<std::string>()->default_value("none"), "window applied to every row before the transforms: none, hann, hamming or blackman")
+	    ("shots", po::value<int>(), "number of shots to collect (asked for if not given)")
+	    ("full-output", "save and transform the full frame instead of the ROI")
+	    ("fvb", "average the ROI rows (every row with --full-output) into one spectrum before transforming")
+	    ("record", po::value<std::string>()->default_value("test.rec"), "binary recording of the shots (see README)")
+	    ("record-shots", po::value<long long>()->default_value(1), "number of shots to record, 0 = all")
+	    ("record-contents", po::value<std::string>()->default_value("both"), "what to record per shot: frames, spectra or both")
+	    ("track-bins", po::value<std::string>(), "FFT bins to follow in every ROI row, e.g. 37 or 35:39,80")
+	    ("track-file", po::value<std::string>()->default_value("bins.csv"), "CSV time series of the tracked bins")
+	    ("track-only", "only evaluate the tracked bins, skip the full row transforms")
+	    ("average", po::value<long long>()->default_value(0), "combine every N shots into running mean and variance (0 = off)")
+	    ("average-file", po::value<std::string>()->default_value("average.rec"), "statistics record per block of --average shots")
+	    ("average-coherent", "also average the complex spectrum, keeping the phase")
+	    ("bias", po::value<std::string>()->default_value(""), "master bias frame to subtract (a recording of the ROI, e.g. from --average)")
+	    ("dark", po::value<std::string>()->default_value(""), "master dark frame to subtract, rescaled to the exposure if --bias is given")
+	    ("flat", po::value<std::string>()->default_value(""), "master flat field to divide by")
+	    ("hot-pixels", po::value<std::string>(), "file of hot pixels to replace, one \"x y\" sensor position per line")
+	    ("cosmic-test", po::value<std::string>()->default_value("none"), "cosmic-ray rejection before the transforms: none, median or local")
+	    ("cosmic-threshold", po::value<int>()->default_value(200), "counts above the median or the neighbours that make a pixel an outlier")
+	    ("cosmic-history", po::value<int>()->default_value(5), "previous shots the median test looks at")
+	    ("preview-rate", po::value<double>()->default_value(20), "live preview refreshes per second, on its own thread (0 = no preview)")
+	    ("preview-width", po::value<int>()->default_value(800), "shrink the preview to at most this many pixels across")
+	    ("profile", po::value<std::string>()->default_value(""), "time every stage and write latency histograms to this JSON file at exit and on SIGUSR1")
+	    ("hdf5", po::value<std::string>(), "also write every shot to this HDF5 file, on a background thread")
+	    ("hdf5-compression", po::value<std::string>()->default_value("deflate"), "HDF5 chunk compression: none, deflate[:level] or lz4")
+	    ("hdf5-buffer", po::value<int>()->default_value(16), "shots buffered for the HDF5 writer thread")
+	    ("roi-rows", po::value<std::string>()->default_value("195:205"), "sensor rows to convert, transform and save, first:last")
+	    ("roi-cols", po::value<std::string>()->default_value("all"), "sensor columns to convert, transform and save, first:last")
+	    ("sensor-roi", po::value<std::string>(), "hardware ROI read off the CCD, x,y,width,height (default full sensor)")
+	    ("bin-x", po::value<int>()->default_value(1), "on-chip horizontal binning")
+	    ("bin-y", po::value<int>()->default_value(1), "on-chip vertical binning")
+	    ("config", po::value<std::string>(), "read further options from a file (name = value lines)")
 	;
 
 	po::variables_map vm;
 	po::store(po::parse_command_line(ac, av, desc), vm);
+	if (vm.count("config")) {
+		// the command line wins over anything set in the file
+		std::ifstream configFile(vm["config"].as<std::string>().c_str());
+		if (configFile)
+			po::store(po::parse_config_file(configFile, desc), vm);
+		else
+			std::cout << "Cannot open config file " << vm["config"].as<std::string>() << "\n";
+	}
 	po::notify(vm);    
 
 	if (vm.count("help")) {
@@ -197,6 +357,12 @@ int main(int ac, char* av[])
 	    std::cout << "Quiet output.\n";
 	}
 
+	// before any thread starts, so they all leave SIGUSR1 to the profile
+	StageProfile profile;
+	std::string profileFile = vm["profile"].as<std::string>();
+	if (!profileFile.empty())
+		profile.DumpOnSignal(profileFile);
+
     PicamHandle camera;
     PicamCameraID id;
     PicamAvailableData data;
@@ -204,67 +370,434 @@ int main(int ac, char* av[])
 	
 	camera = InitializeCamera(id, data, errors, verboseOutput);
 
-    ConfigureCamera( camera, verboseOutput );
+	PicamRoi sensorRoi = FullSensorRoi();
+	if (vm.count("sensor-roi") && !ParseSensorRoi(vm["sensor-roi"].as<std::string>().c_str(), &sensorRoi))
+		std::cout << "Cannot parse sensor ROI, reading the full sensor\n";
+	sensorRoi.x_binning = vm["bin-x"].as<int>();
+	sensorRoi.y_binning = vm["bin-y"].as<int>();
+
+    CameraParameters parameters( camera );
+    if (!ConfigureCamera( parameters, sensorRoi, verboseOutput )) {
+		Picam_CloseCamera( camera );
+	    Picam_UninitializeLibrary();
+	    return 1;
+    }
+
+	// everything downstream sizes itself from what the camera committed
+	FrameGeometry geometry;
+	if (!GetFrameGeometry(camera, &geometry)) {
+		std::cout << "Cannot read the frame geometry\n";
+		Picam_CloseCamera( camera );
+	    Picam_UninitializeLibrary();
+	    return 1;
+	}
+	if (verboseOutput)
+		std::cout << "Frames are " << geometry.rows << "x" << geometry.cols
+		          << ", readout stride " << geometry.readoutStride << " bytes\n";
+
+	// time stamps and frame numbers follow the pixels of every readout
+	ReadoutMetadata metadata(vm["frame-report"].as<double>());
+	if (!metadata.Configure(camera, geometry))
+		std::cout << "Camera adds no frame tracking, dropped frames will not be detected\n";
 
     // Take input commands
     int numShots = 10;
-    std::cout << "Enter the number of shots to collect: ";
-    std::cin >> numShots;
+    if (vm.count("shots")) {
+    	numShots = vm["shots"].as<int>();
+    } else {
+	    std::cout << "Enter the number of shots to collect: ";
+	    std::cin >> numShots;
+	}
+
+    bool fullOutput = vm.count("full-output");
+    if (!fullOutput && !vm.count("shots")) {
+		std::cout << "Enter the output type (1 -> Full, 0-> ROI): ";
+		std::cin >> fullOutput;
+	}
 
-    bool fullOutput = false;
-	std::cout << "Enter the output type (1 -> Full, 0-> ROI): ";
-	std::cin >> fullOutput;
+	// Only the ROI is converted, padded and transformed; everything else
+	// in the frame is never touched after readout.
+	Range roiRows = Range(0, geometry.rows);
+	Range roiCols = Range(0, geometry.cols);
+	if (!fullOutput
+	    && (!ParseRange(vm["roi-rows"].as<std::string>(), geometry.y, geometry.yBinning, geometry.rows, &roiRows)
+	        || !ParseRange(vm["roi-cols"].as<std::string>(), geometry.x, geometry.xBinning, geometry.cols, &roiCols))) {
+		Picam_CloseCamera( camera );
+	    Picam_UninitializeLibrary();
+	    return 1;
+	}
+	if (verboseOutput)
+		std::cout << "ROI rows " << roiRows.start << "-" << roiRows.end - 1
+		          << ", columns " << roiCols.start << "-" << roiCols.end - 1 << "\n";
+
+	// Full vertical binning in software: the ROI band is averaged into a
+	// single float row as each shot is processed, and from then on that
+	// row is all that is transformed, tracked and recorded.
+	bool binRows = vm.count("fvb");
+	int rows = binRows ? 1 : roiRows.size();
+	if (binRows && verboseOutput)
+		std::cout << "Averaging " << roiRows.size() << " rows into one spectrum\n";
+
+	// The median test looks at the last few shots in order, which
+	// processing threads taking shots as they come cannot give it: each
+	// would see a random, ever older share of them.
+	if (vm.count("pipeline") && vm["process-threads"].as<int>() > 1
+	    && vm["cosmic-test"].as<std::string>() == "median") {
+		std::cout << "--cosmic-test median needs --process-threads 1 with --pipeline\n";
+		Picam_CloseCamera( camera );
+	    Picam_UninitializeLibrary();
+	    return 1;
+	}
 
+	// In streaming mode the camera reads out back-to-back and we process
+	// frames in place in the circular buffer as the loop gets to them.
+	FrameStream* stream = NULL;
+	if (vm.count("stream") || vm.count("pipeline")) {
+		stream = new FrameStream(camera, parameters, vm["circular-readouts"].as<int>(), verboseOutput);
+		stream->SetMetadata(&metadata);
+		if (!stream->Start()) {
+			delete stream;
+			stream = NULL;
+			std::cout << "Falling back to single-shot acquisition\n";
+		}
+	}
 
-    for (int i = 0; i < numShots; i++)
-    {
-    	// Collect one shot:
-    	Mat image = CollectShot(camera, data, errors, verboseOutput);
-
-    	Mat padded;
-	    int m = getOptimalDFTSize( image.rows );
-	    int n = getOptimalDFTSize( image.cols );
-	    copyMakeBorder(image, padded, 0, m - image.rows, 0, n - image.cols, BORDER_CONSTANT, Scalar::all(0));
-
-	    Mat planes[] = {Mat_<float>(padded), Mat::zeros(padded.size(), CV_32F)};
-	    Mat complexI;
-	    merge(planes, 2, complexI);         // Add to the expanded another plane with zeros
-
-	    dft(complexI, complexI, DFT_ROWS);            // this way the result may fit in the source matrix
-
-	    // compute the magnitude and switch to logarithmic scale
-	    // => log(1 + sqrt(Re(DFT(I))^2 + Im(DFT(I))^2))
-	    split(complexI, planes);                   // planes[0] = Re(DFT(I), planes[1] = Im(DFT(I))
-	    //magnitude(planes[0], planes[1], planes[0]);// planes[0] = magnitude
-	    Mat realI = planes[0];
-	    Mat imagI = planes[1];
-
-	    //magI += Scalar::all(1);                    // switch to logarithmic scale
-	    //log(magI, magI);
-
-	    // crop the spectrum, if it has an odd number of rows or columns
-	    realI = realI(Rect(0, 0, realI.cols & -2, realI.rows & -2));
-	    imagI = imagI(Rect(0, 0, imagI.cols & -2, imagI.rows & -2));
-
-	    if (verboseOutput) std::cout << "Display data\n" ;
-
-	    imshow("Input Image"       , image   );    // Show the result
-	    //imshow("spectrum (real)", realI);
-	    waitKey();
-	    // if( waitKey(30) >= 0 ) break; // wait 30 ms for key interrupt
-	    if(i == 0){
-	    	FileStorage fs("test.yml", FileStorage::WRITE); // This is an easy way, but uses space!
-
-	    	fs << "frame number" << i;
-	    	fs << "image" << image.rowRange(Range(195,205)); // save middle 10 rows
-	    	fs << "fft-real" << realI.rowRange(Range(195,205)); // save both real and imag parts of FFT
-	    	fs << "fft-imag" << imagI.rowRange(Range(195,205)); 
-	    	fs.release();
-	    	imwrite("datafile.png", image.rowRange(Range(195,205)));
-	    }
+	// Every processing thread (just the one unless pipelined) gets its own
+	// row transform and work buffers, planned and sized once from the ROI
+	// and reused for every shot.
+	bool pipelined = stream && vm.count("pipeline");
+	int processThreads = pipelined ? std::max(1, vm["process-threads"].as<int>()) : 1;
+	int paddedCols = getOptimalDFTSize(roiCols.size());
+	std::vector<RowFFT*> rowFFTs(processThreads, (RowFFT*)NULL);
+
+	// each thread times its own stages; without the pipeline one thread does it all
+	std::vector<StageTimes*> processTimes(processThreads, (StageTimes*)NULL);
+	StageTimes* acquisitionTimes = NULL;
+	StageTimes* writerTimes = NULL;
+	if (!profileFile.empty()) {
+		acquisitionTimes = profile.AddThread(pipelined ? "acquisition" : "main");
+		for (int t = 0; t < processThreads; t++)
+			processTimes[t] = pipelined ? profile.AddThread("process " + std::to_string(t)) : acquisitionTimes;
+		writerTimes = pipelined ? profile.AddThread("writer") : acquisitionTimes;
+	}
+	std::vector<FFTWorkspace*> workspaces(processThreads, (FFTWorkspace*)NULL);
+	RowWindow window = WindowNone;
+	if (!RowConverter::ParseWindow(vm["fft-window"].as<std::string>(), &window))
+		std::cout << "Unknown --fft-window, not windowing\n";
+	std::string wisdomFile = vm["fft-wisdom"].as<std::string>();
+
+	// Selected bins are evaluated on their own (Goertzel), which is far
+	// cheaper than a whole row transform when that is all that is needed.
+	std::vector<int> trackBins;
+	if (vm.count("track-bins") && !BinTracker::ParseBins(vm["track-bins"].as<std::string>(), &trackBins))
+		std::cout << "Cannot parse --track-bins, not tracking\n";
+	bool trackOnly = vm.count("track-only") && !trackBins.empty();
+	std::vector<BinTracker*> trackers(processThreads, (BinTracker*)NULL);
+	if (!trackBins.empty())
+		for (int t = 0; t < processThreads; t++)
+			trackers[t] = new BinTracker(rows, roiCols.size(), paddedCols, trackBins);
+
+	if (vm["fft-engine"].as<std::string>() == "fftw" && !trackOnly) {
+		if (RowFFT::ImportWisdom(wisdomFile) && verboseOutput)
+			std::cout << "Loaded FFTW wisdom from " << wisdomFile << "\n";
+		int fftThreads = vm["fft-threads"].as<int>();
+		// every processing thread has its own workers, so they split the cores
+		if (fftThreads <= 0)
+			fftThreads = std::max(1, (int)std::thread::hardware_concurrency() / processThreads);
+		unsigned planFlags = FFTW_MEASURE;
+		if (!RowFFT::ParsePlanFlags(vm["fft-plan"].as<std::string>(), &planFlags))
+			std::cout << "Unknown --fft-plan, planning with measure\n";
+		if (verboseOutput) std::cout << "Planning row FFTs...\n";
+		// the planner remembers the first plan, so the others are quick
+		for (int t = 0; t < processThreads; t++)
+			rowFFTs[t] = new RowFFT(rows, roiCols.size(), paddedCols, planFlags,
+			                        !vm.count("fft-full-spectrum"), fftThreads);
+		RowFFT::ExportWisdom(wisdomFile);
+	}
+	// only the OpenCV engine needs an input buffer of its own
+	int spectrumCols = rowFFTs[0] ? rowFFTs[0]->OutputCols() : paddedCols;
+	for (int t = 0; t < processThreads; t++) {
+		workspaces[t] = new FFTWorkspace();
+		if (!rowFFTs[t] && !trackOnly)
+			workspaces[t]->Preallocate(&workspaces[t]->complexI, rows, paddedCols, CV_32FC2);
+	}
+
+	// Record straight to a binary file; the header carries everything
+	// needed to interpret the records.
+	Outputs outputs;
+	outputs.snapshotWritten = false;
+	outputs.recordShots = vm["record-shots"].as<long long>();
+	std::string contents = vm["record-contents"].as<std::string>();
+	RecordHeader header = MakeRecordHeader(rows, roiCols.size(), paddedCols,
+	                                       spectrumCols,
+	                                       (contents != "spectra" ? RecordFrames : 0) |
+	                                       (contents != "frames" && !trackOnly ? RecordSpectra : 0) |
+	                                       (binRows ? RecordFloatFrames : 0));
+	header.sensorX = geometry.x;
+	header.sensorY = geometry.y;
+	header.xBinning = geometry.xBinning;
+	header.yBinning = geometry.yBinning;
+	header.roiFirstRow = roiRows.start;
+	header.roiFirstCol = roiCols.start;
+	header.binnedRows = binRows ? roiRows.size() : 0;
+	header.window = window;
+	piflt exposure = 0, adcSpeed = 0;
+	Picam_GetParameterFloatingPointValue( camera, PicamParameter_ExposureTime, &exposure );
+	Picam_GetParameterFloatingPointValue( camera, PicamParameter_AdcSpeed, &adcSpeed );
+	header.exposureMs = exposure;
+	header.adcMHz = adcSpeed;
+	outputs.recorder.Open(vm["record"].as<std::string>(), header);
+#ifdef HAVE_HDF5
+	outputs.hdf5 = NULL;
+	if (vm.count("hdf5")) {
+		outputs.hdf5 = new Hdf5Writer(vm["hdf5-buffer"].as<int>());
+		if (!outputs.hdf5->Open(vm["hdf5"].as<std::string>(), header, vm["hdf5-compression"].as<std::string>())) {
+			delete outputs.hdf5;
+			outputs.hdf5 = NULL;
+		}
+	}
+#else
+	if (vm.count("hdf5"))
+		std::cout << "Built without HDF5, ignoring --hdf5\n";
+#endif
+	if (!trackBins.empty())
+		outputs.series.Open(vm["track-file"].as<std::string>(), rows, roiRows.start, trackBins);
+	outputs.preview = NULL;
+	if (vm["preview-rate"].as<double>() > 0) {
+		outputs.preview = new LivePreview("Input Image", vm["preview-rate"].as<double>(), vm["preview-width"].as<int>());
+		outputs.preview->Start();
+	}
+	outputs.average = NULL;
+	outputs.averageShots = vm["average"].as<long long>();
+	outputs.averageBlocks = 0;
+	if (outputs.averageShots > 0) {
+		int spectrumCols = header.contents & RecordSpectra ? header.spectrumCols : 0;
+		bool coherent = vm.count("average-coherent") && spectrumCols > 0;
+		outputs.average = new ShotAccumulator(rows, roiCols.size(), spectrumCols, coherent);
+		RecordHeader statistics = header;
+		statistics.contents = RecordStatistics | RecordFrames
+		                    | (spectrumCols ? RecordSpectra : 0) | (coherent ? RecordCoherent : 0);
+		outputs.averageFile.Open(vm["average-file"].as<std::string>(), statistics);
+	}
+	outputs.started = std::chrono::steady_clock::now();
+	outputs.times = writerTimes;
+
+	// Masters are recordings of this ROI; the raw frames are still what
+	// gets recorded, the correction only feeds the transforms.
+	Calibration calibration(header);
+	if (!vm["bias"].as<std::string>().empty() || !vm["dark"].as<std::string>().empty()
+	    || !vm["flat"].as<std::string>().empty()) {
+		if (calibration.Load(vm["bias"].as<std::string>(), vm["dark"].as<std::string>(), vm["flat"].as<std::string>()))
+			calibration.PrintStatistics();
+		else
+			std::cout << "Not calibrating\n";
+	}
+	const Calibration* correction = calibration.Active() ? &calibration : NULL;
+
+	// One pass from the 16-bit ROI to corrected, windowed, padded float
+	// rows, shared by every processing thread (it is only read).
+	RowConverter converter(rows, roiCols.size());
+	converter.SetCalibration(correction);
+	converter.SetWindow(window);
+	if (verboseOutput)
+		std::cout << "Converting rows with the " << converter.Kernel() << " kernel, "
+		          << RowConverter::WindowName(window) << " window\n";
+
+	// Hot pixels and cosmic rays are taken out of a copy of the ROI that
+	// feeds the transforms and the tracked bins.
+	std::vector<int> hotPixels;
+	if (vm.count("hot-pixels")) {
+		// the filter cleans the whole band, before it is binned
+		RecordHeader band = header;
+		band.rows = roiRows.size();
+		band.binnedRows = 0;
+		PixelFilter::LoadHotPixels(vm["hot-pixels"].as<std::string>(), band, &hotPixels);
+	}
+	PixelFilter::Test cosmicTest = PixelFilter::None;
+	if (!PixelFilter::ParseTest(vm["cosmic-test"].as<std::string>(), &cosmicTest))
+		std::cout << "Unknown cosmic-ray test, not rejecting cosmic rays\n";
+	std::vector<PixelFilter*> filters(processThreads, (PixelFilter*)NULL);
+	if (!hotPixels.empty() || cosmicTest != PixelFilter::None) {
+		for (int t = 0; t < processThreads; t++) {
+			filters[t] = new PixelFilter(roiRows.size(), roiCols.size(), cosmicTest,
+			                             vm["cosmic-history"].as<int>(), vm["cosmic-threshold"].as<int>());
+			filters[t]->SetHotPixels(hotPixels);
+		}
+	}
+	std::vector<RowBinner*> binners(processThreads, (RowBinner*)NULL);
+	if (binRows)
+		for (int t = 0; t < processThreads; t++)
+			binners[t] = new RowBinner(roiRows.size(), roiCols.size());
+	for (int t = 0; t < processThreads; t++)
+		if (trackers[t])
+			trackers[t]->SetConverter(&converter);
+
+	// Transform and track one shot's ROI on processing thread t
+	auto processShot = [&](int t, const Mat& image, Shot& shot) {
+		Mat roi = image(roiRows, roiCols);
+		if (filters[t]) {
+			StageTimes::Clock::time_point mark = StageTimes::Clock::now();
+			roi = Mat(roi.rows, roi.cols, CV_16U,
+			          (void*)filters[t]->Clean(roi.ptr<uint16_t>(0), roi.step1()));
+			MarkStage(processTimes[t], StageFilter, mark);
+		}
+		if (binners[t]) {
+			StageTimes::Clock::time_point mark = StageTimes::Clock::now();
+			shot.binned.create(1, roi.cols, CV_32F);
+			binners[t]->Bin(roi.ptr<uint16_t>(0), roi.step1(), shot.binned.ptr<float>(0));
+			roi = shot.binned;
+			MarkStage(processTimes[t], StageBin, mark);
+		}
+		if (!trackOnly)
+			TransformRows(roi, rowFFTs[t], converter, *workspaces[t], shot.spectrum, processTimes[t]);
+		if (trackers[t]) {
+			StageTimes::Clock::time_point mark = StageTimes::Clock::now();
+			shot.tracked.create(roi.rows, (int)trackBins.size(), CV_64FC2);
+			if (binners[t])
+				trackers[t]->Evaluate(roi.ptr<float>(0), (int)roi.step1(), shot.tracked.ptr<double>(0));
+			else
+				trackers[t]->Evaluate(roi.ptr<unsigned short>(0), (int)roi.step1(), shot.tracked.ptr<double>(0));
+			MarkStage(processTimes[t], StageTrack, mark);
+		}
+	};
+
+	// What processing fills in for a shot, set aside for every shot in
+	// flight before the first one arrives
+	std::vector<FFTWorkspace*> shotBuffers;
+	auto prepareShot = [&](Shot& shot) {
+		shot.buffers = new FFTWorkspace();
+		if (!trackOnly) {
+			shot.buffers->Preallocate(&shot.spectrum[0], rows, spectrumCols, CV_32F);
+			shot.buffers->Preallocate(&shot.spectrum[1], rows, spectrumCols, CV_32F);
+		}
+		if (binRows)
+			shot.buffers->Preallocate(&shot.binned, 1, roiCols.size(), CV_32F);
+		if (!trackBins.empty())
+			shot.buffers->Preallocate(&shot.tracked, rows, (int)trackBins.size(), CV_64FC2);
+		shotBuffers.push_back(shot.buffers);
+	};
+
+	if (pipelined) {
+		Pipeline::Backpressure backpressure = Pipeline::Block;
+		if (!Pipeline::ParseBackpressure(vm["backpressure"].as<std::string>(), &backpressure))
+			std::cout << "Unknown backpressure policy, blocking when full\n";
+
+		Pipeline pipeline(stream, vm["pipeline-slots"].as<int>(), processThreads, backpressure,
+			[&](int worker, Shot& shot) {
+				Mat image(geometry.rows, geometry.cols, CV_16U, &shot.readout[0]);
+				processShot(worker, image, shot);
+				workspaces[worker]->CheckReallocations();
+				shot.buffers->CheckReallocations();
+			},
+			[&](Shot& shot) {
+				Mat image(geometry.rows, geometry.cols, CV_16U, &shot.readout[0]);
+				OutputShot(shot, image, roiRows, roiCols, outputs, verboseOutput);
+			});
+		pipeline.SetTimes(acquisitionTimes);
+		for (size_t s = 0; s < pipeline.Slots().size(); s++)
+			prepareShot(pipeline.Slots()[s]);
+		pipeline.Run(numShots);
+		pipeline.PrintStatistics();
+	} else {
+		// every shot reuses the same buffers
+		Shot shot;
+		prepareShot(shot);
+		ReadoutBatch batch(geometry);
+		batch.SetMetadata(&metadata);
+		int batchSize = std::max(1, vm["batch"].as<int>());
+		int nextReadout = 0;
+	    for (int i = 0; i < numShots; i++)
+	    {
+	    	// Collect one shot:
+	    	StageTimes::Clock::time_point mark = StageTimes::Clock::now();
+	    	Mat image;
+	    	FrameHandle frame;              // keeps a streamed readout alive for this iteration
+	    	if (stream) {
+	    		if (!stream->Pop(frame))
+	    			break;
+	    		image = Mat(geometry.rows, geometry.cols, CV_16U, (void*)frame.Data());
+	    	} else {
+	    		image = CollectShot(camera, batch, nextReadout, std::min(batchSize, numShots - i), geometry, verboseOutput);
+	    		if (image.empty())
+	    			break;
+	    	}
+	    	MarkStage(acquisitionTimes, StageAcquire, mark);
+	    	shot.number = i;
+	    	shot.timestamp = std::chrono::steady_clock::now();
+
+		    processShot(0, image, shot);
+		    if (workspaces[0]->CheckReallocations() + shot.buffers->CheckReallocations() > 0 && verboseOutput)
+		    	std::cout << "Workspace buffer reallocated on frame " << i << "\n";
+
+		    OutputShot(shot, image, roiRows, roiCols, outputs, verboseOutput);
+		}
+		if (!stream && verboseOutput)
+			std::cout << "Single shots: " << batch.Frames() << " frames from "
+			          << batch.Calls() << " Picam_Acquire calls\n";
 	}
 
+	if (stream) {
+		stream->Stop();
+		stream->PrintStatistics();
+		delete stream;
+	}
+	metadata.PrintStatistics();
+	if (outputs.preview) {
+		outputs.preview->Stop();
+		outputs.preview->PrintStatistics();
+		delete outputs.preview;
+	}
+	outputs.recorder.Close();
+	outputs.recorder.PrintStatistics();
+#ifdef HAVE_HDF5
+	if (outputs.hdf5) {
+		outputs.hdf5->Close();
+		outputs.hdf5->PrintStatistics();
+		delete outputs.hdf5;
+	}
+#endif
+	outputs.series.Close();
+	if (outputs.average) {
+		// whatever is left of the last block
+		if (outputs.average->Shots() > 0)
+			outputs.averageFile.WriteStatistics(outputs.averageBlocks++, std::chrono::steady_clock::now(),
+			                                    outputs.average->Shots(), outputs.average->Planes());
+		outputs.averageFile.Close();
+		std::cout << "Average: " << outputs.averageBlocks << " block(s) of up to "
+		          << outputs.averageShots << " shots to " << vm["average-file"].as<std::string>() << "\n";
+		delete outputs.average;
+	}
+	for (int t = 0; t < processThreads; t++) {
+		if (rowFFTs[t]) {
+			rowFFTs[t]->PrintUtilisation();
+			delete rowFFTs[t];
+		}
+		workspaces[t]->PrintStatistics("Workspace");
+		delete workspaces[t];
+		delete trackers[t];
+		delete binners[t];
+		if (filters[t]) {
+			filters[t]->PrintStatistics();
+			delete filters[t];
+		}
+	}
+	long long shotReallocations = 0, shotFrames = 0;
+	size_t shotBytes = 0;
+	for (size_t s = 0; s < shotBuffers.size(); s++) {
+		shotReallocations += shotBuffers[s]->Reallocations();
+		shotFrames += shotBuffers[s]->Frames();
+		shotBytes += shotBuffers[s]->Bytes();
+		delete shotBuffers[s];
+	}
+	std::cout << "Shot buffers: " << shotBuffers.size() << " shot(s) in flight, " << shotBytes / 1024 << " kB, "
+	          << shotReallocations << " reallocation(s) in " << shotFrames << " frames" << std::endl;
+
+	if (!profileFile.empty() && profile.WriteJson(profileFile)) {
+		profile.PrintSummary();
+		std::cout << "Profile written to " << profileFile << "\n";
+	}
+	if (verboseOutput)
+		parameters.PrintStatistics();
 	Picam_CloseCamera( camera );
     Picam_UninitializeLibrary();
-    //TODO add csv file output of complex numbers from one element of FFT result. (command line flag)
 }
@@ -0,0 +1,241 @@
+#include "FrameStream.h"
+
+#include <iostream>
+
+#define READOUT_TIMEOUT_MS  1000
+
+FrameHandle::FrameHandle(FrameHandle&& other)
+    : owner(other.owner),
+      data(other.data),
+      run(other.run)
+{
+    other.owner = NULL;
+    other.data = NULL;
+}
+
+FrameHandle& FrameHandle::operator=(FrameHandle&& other)
+{
+    if( this != &other )
+    {
+        Release();
+        owner = other.owner;
+        data = other.data;
+        run = other.run;
+        other.owner = NULL;
+        other.data = NULL;
+    }
+    return *this;
+}
+
+void FrameHandle::Release()
+{
+    if( owner && data )
+        owner->Release( run );
+    owner = NULL;
+    data = NULL;
+}
+
+FrameStream::FrameStream(PicamHandle camera, CameraParameters& parameters, int circularReadouts, bool verboseOutput)
+    : camera(camera),
+      parameters(&parameters),
+      verboseOutput(verboseOutput),
+      metadata(NULL),
+      readoutStride(0),
+      frameBytes(0),
+      circularReadouts(circularReadouts),
+      outstanding(0),
+      run(0),
+      acquired(0),
+      errors(PicamAcquisitionErrorsMask_None),
+      running(false),
+      stopping(false)
+{
+}
+
+FrameStream::~FrameStream()
+{
+    Stop();
+}
+
+bool FrameStream::Start()
+{
+    PicamError error;
+
+    // ReadoutCount = 0 keeps the camera acquiring until we stop it
+    error = parameters->SetLargeInteger( PicamParameter_ReadoutCount, 0 );
+    if( error != PicamError_None )
+    {
+        std::cout << "Cannot set continuous readout count\n";
+        return false;
+    }
+
+    // restarting with nothing changed needs no commit
+    if( !parameters->Commit( verboseOutput ) )
+    {
+        std::cout << "Cannot commit streaming parameters\n";
+        return false;
+    }
+
+    Picam_GetParameterIntegerValue( camera, PicamParameter_ReadoutStride, &readoutStride );
+    Picam_GetParameterIntegerValue( camera, PicamParameter_FrameSize, &frameBytes );
+
+    circularBuffer.resize( (size_t)readoutStride * circularReadouts );
+
+    PicamAcquisitionBuffer buffer;
+    buffer.memory = &circularBuffer[0];
+    buffer.memory_size = circularBuffer.size();
+    error = Picam_SetAcquisitionBuffer( camera, &buffer );
+    if( error != PicamError_None )
+    {
+        std::cout << "Cannot set circular acquisition buffer\n";
+        return false;
+    }
+
+    if (verboseOutput)
+        std::cout << "Streaming: " << circularReadouts << " readouts of " << readoutStride
+                  << " bytes in the circular buffer\n";
+
+    error = Picam_StartAcquisition( camera );
+    if( error != PicamError_None )
+    {
+        std::cout << "Cannot start acquisition\n";
+        return false;
+    }
+
+    if( metadata )
+        metadata->NewAcquisition();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        outstanding = 0;
+        run++;
+        running = true;
+        stopping = false;
+    }
+    reader = std::thread(&FrameStream::ReaderLoop, this);
+    return true;
+}
+
+void FrameStream::Stop()
+{
+    if( !reader.joinable() )
+        return;
+
+    // once the camera has stopped it writes no more readouts, so the reader
+    // may collect the last update without waiting for held handles; those
+    // stay valid until the next Start()
+    pibln acquiring = false;
+    Picam_IsAcquisitionRunning( camera, &acquiring );
+    if( acquiring )
+        Picam_StopAcquisition( camera );
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+        ready.clear();
+        released.notify_all();
+    }
+
+    reader.join();
+
+    // give the camera its default buffer back for single-shot Picam_Acquire
+    PicamAcquisitionBuffer buffer;
+    buffer.memory = NULL;
+    buffer.memory_size = 0;
+    Picam_SetAcquisitionBuffer( camera, &buffer );
+}
+
+void FrameStream::ReaderLoop()
+{
+    PicamAvailableData data;
+    PicamAcquisitionStatus status;
+    status.running = true;
+
+    while( status.running )
+    {
+        // the next wait lets PICam overwrite the previous update's readouts
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while( outstanding > 0 && !stopping )
+                released.wait( guard );
+        }
+
+        PicamError error = Picam_WaitForAcquisitionUpdate( camera, READOUT_TIMEOUT_MS, &data, &status );
+        if( error == PicamError_TimeOutOccurred )
+        {
+            Picam_IsAcquisitionRunning( camera, &status.running );
+            continue;
+        }
+        if( error != PicamError_None )
+        {
+            std::cout << "Acquisition update failed, stopping stream\n";
+            Picam_StopAcquisition( camera );
+            break;
+        }
+
+        const pibyte* readout = (const pibyte*)data.initial_readout;
+        if( metadata )
+        {
+            metadata->AddErrors( status.errors );
+            for( pi64s r = 0; r < data.readout_count; r++ )
+                metadata->Add( readout + r * readoutStride );
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        acquired += data.readout_count;
+        errors = (PicamAcquisitionErrorsMask)(errors | status.errors);
+        if( stopping )
+            continue;
+        for( pi64s r = 0; r < data.readout_count; r++ )
+            ready.push_back( readout + r * readoutStride );
+        outstanding += (int)data.readout_count;
+        available.notify_all();
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    running = false;
+    available.notify_all();
+}
+
+bool FrameStream::Pop(FrameHandle& frame)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while( ready.empty() && running )
+        available.wait( guard );
+    if( ready.empty() )
+        return false;
+
+    const pibyte* readout = ready.front();
+    ready.pop_front();
+    long long current = run;
+    guard.unlock();
+
+    frame = FrameHandle( this, readout, current );
+    return true;
+}
+
+void FrameStream::Release(long long run)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    // handles from before the last Stop() no longer count
+    if( run != this->run || stopping )
+        return;
+    if( --outstanding == 0 )
+        released.notify_all();
+}
+
+long long FrameStream::FramesAcquired() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return acquired;
+}
+
+void FrameStream::PrintStatistics() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    std::cout << "Stream: " << acquired << " frames acquired";
+    if( errors & PicamAcquisitionErrorsMask_DataLost )
+        std::cout << ", camera reported data lost (circular buffer overrun)";
+    if( errors & PicamAcquisitionErrorsMask_ConnectionLost )
+        std::cout << ", connection lost";
+    std::cout << std::endl;
+}
@@ -0,0 +1,116 @@
+// Continuous acquisition for the PyLoN.
+//
+// Instead of calling the blocking Picam_Acquire once per shot, the camera
+// is started in continuous mode (ReadoutCount = 0) with a circular buffer
+// that we own, so the sensor keeps reading out back-to-back while the main
+// loop does the DFT, display and file output.
+//
+// Frames are never copied out of the circular buffer.  Pop() hands out a
+// FrameHandle that points at the readout itself; PICam may only reuse that
+// memory once we call Picam_WaitForAcquisitionUpdate again, so the reader
+// thread holds off its next wait until every handle from the previous
+// update has been released.  In the meantime the camera keeps filling the
+// free part of the buffer.  If processing falls so far behind that the
+// buffer fills up, the camera reports lost data.
+
+#ifndef FRAMESTREAM_H
+#define FRAMESTREAM_H
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "picam.h"
+#include "ReadoutMetadata.h"
+#include "CameraParameters.h"
+
+class FrameStream;
+
+// Reference to one readout for as long as processing needs it.  Handles
+// are move-only; the readout goes back to the acquisition side when the
+// handle is released or destroyed.  A handle may outlive Stop(), and its
+// pixels stay valid until the next Start(), but not the FrameStream.
+class FrameHandle
+{
+public:
+    FrameHandle() : owner(NULL), data(NULL), run(0) {}
+    FrameHandle(FrameHandle&& other);
+    FrameHandle& operator=(FrameHandle&& other);
+    ~FrameHandle() { Release(); }
+
+    bool Valid() const { return data != NULL; }
+    const pibyte* Data() const { return data; }
+    void Release();
+
+private:
+    friend class FrameStream;
+    FrameHandle(FrameStream* owner, const pibyte* data, long long run) : owner(owner), data(data), run(run) {}
+    FrameHandle(const FrameHandle&);
+    FrameHandle& operator=(const FrameHandle&);
+
+    FrameStream* owner;
+    const pibyte* data;
+    long long run;              // the Start() the readout came from
+};
+
+class FrameStream
+{
+public:
+    // continuous mode is set and committed through parameters
+    FrameStream(PicamHandle camera, CameraParameters& parameters, int circularReadouts, bool verboseOutput);
+    ~FrameStream();
+
+    bool Start();                   // commit continuous mode and start the reader thread
+    void Stop();                    // stop the camera and join the reader thread;
+                                    // does not wait for outstanding handles
+
+    // Blocks until a frame is available and points frame at it.  Returns
+    // false once the stream has stopped and every readout has been handed
+    // out.
+    bool Pop(FrameHandle& frame);
+
+    // every readout and update passes through metadata (if set) on the
+    // reader thread, in the order the camera delivered them; set before
+    // Start()
+    void SetMetadata(ReadoutMetadata* metadata) { this->metadata = metadata; }
+
+    piint FrameBytes() const { return frameBytes; }
+    piint ReadoutStride() const { return readoutStride; }
+
+    long long FramesAcquired() const;
+    void PrintStatistics() const;
+
+private:
+    friend class FrameHandle;
+    void ReaderLoop();
+    void Release(long long run);    // one handed-out readout is done with
+
+    PicamHandle camera;
+    CameraParameters* parameters;
+    bool verboseOutput;
+    ReadoutMetadata* metadata;
+
+    piint readoutStride;
+    piint frameBytes;
+
+    // memory handed to Picam_SetAcquisitionBuffer
+    std::vector<pibyte> circularBuffer;
+    int circularReadouts;
+
+    std::deque<const pibyte*> ready;    // readouts not yet popped
+    int outstanding;                    // readouts of the last update not yet released
+    long long run;                      // counts Start()s; older handles are ignored
+
+    long long acquired;
+    PicamAcquisitionErrorsMask errors;
+    bool running;
+    bool stopping;
+
+    std::thread reader;
+    mutable std::mutex lock;
+    std::condition_variable available;
+    std::condition_variable released;
+};
+
+#endif
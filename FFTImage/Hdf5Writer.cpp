@@ -0,0 +1,371 @@
+#include "Hdf5Writer.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+
+#define GROW_SHOTS        256       // datasets are extended this many shots at a time
+#define SHOT_LIST_CHUNK   1024      // chunk of the per-shot number/timestamp lists
+#define DEFLATE_LEVEL     4
+#define H5Z_FILTER_LZ4    32004     // registered id of the LZ4 plugin
+
+typedef std::chrono::steady_clock Clock;
+
+static void WriteAttribute(hid_t object, const char* name, hid_t type, const void* value)
+{
+    hid_t space = H5Screate( H5S_SCALAR );
+    hid_t attribute = H5Acreate2( object, name, type, space, H5P_DEFAULT, H5P_DEFAULT );
+    H5Awrite( attribute, type, value );
+    H5Aclose( attribute );
+    H5Sclose( space );
+}
+
+Hdf5Writer::Hdf5Writer(int bufferedShots)
+    : pixelBytes(sizeof(uint16_t)),
+      file(-1),
+      frames(-1),
+      real(-1),
+      imag(-1),
+      numbers(-1),
+      timestamps(-1),
+      compressFilter(0),
+      compressLevel(0),
+      allocated(0),
+      shots(0),
+      failed(false),
+      slots(bufferedShots < 1 ? 1 : bufferedShots),
+      closing(false),
+      waits(0),
+      waitSeconds(0),
+      writeSeconds(0)
+{
+    memset( &header, 0, sizeof(header) );
+}
+
+Hdf5Writer::~Hdf5Writer()
+{
+    Close();
+}
+
+bool Hdf5Writer::Open(const std::string& path, const RecordHeader& h, const std::string& compression)
+{
+    Close();
+    header = h;
+    bool floatFrames = header.contents & RecordFloatFrames;
+    pixelBytes = floatFrames ? sizeof(float) : sizeof(uint16_t);
+
+    if( compression == "none" )
+        compressFilter = 0;
+    else if( compression == "lz4" )
+    {
+        compressFilter = H5Z_FILTER_LZ4;
+        if( H5Zfilter_avail( H5Z_FILTER_LZ4 ) <= 0 )
+        {
+            std::cout << "HDF5 LZ4 filter not installed, using deflate\n";
+            compressFilter = H5Z_FILTER_DEFLATE;
+            compressLevel = DEFLATE_LEVEL;
+        }
+    }
+    else if( compression == "deflate" || compression.compare( 0, 8, "deflate:" ) == 0 )
+    {
+        compressFilter = H5Z_FILTER_DEFLATE;
+        compressLevel = DEFLATE_LEVEL;
+        if( compression.size() > 7 )
+        {
+            // gzip levels run from 0 (store) to 9
+            const char* level = compression.c_str() + 8;
+            char* end = NULL;
+            long parsed = strtol( level, &end, 10 );
+            if( end == level || *end != '\0' || parsed < 0 || parsed > 9 )
+            {
+                std::cout << "Cannot parse --hdf5-compression " << compression << ", the deflate level must be 0 to 9\n";
+                return false;
+            }
+            compressLevel = (int)parsed;
+        }
+    }
+    else
+    {
+        std::cout << "Unknown HDF5 compression \"" << compression << "\", writing uncompressed\n";
+        compressFilter = 0;
+    }
+
+    file = H5Fcreate( path.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT );
+    if( file < 0 )
+    {
+        std::cout << "Cannot create HDF5 file " << path << "\n";
+        return false;
+    }
+    this->path = path;
+    opened = Clock::now();
+    header.startTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::system_clock::now().time_since_epoch() ).count();
+
+    // the recording header, so a file can be interpreted on its own
+    hid_t root = H5Gopen2( file, "/", H5P_DEFAULT );
+    const struct { const char* name; int32_t value; } ints[] = {
+        { "rows", header.rows }, { "cols", header.cols },
+        { "padded-cols", header.paddedCols }, { "spectrum-cols", header.spectrumCols },
+        { "sensor-x", header.sensorX }, { "sensor-y", header.sensorY },
+        { "x-binning", header.xBinning }, { "y-binning", header.yBinning },
+        { "roi-first-row", header.roiFirstRow }, { "roi-first-col", header.roiFirstCol },
+        { "binned-rows", header.binnedRows }, { "window", header.window },
+    };
+    for( size_t i = 0; i < sizeof(ints) / sizeof(ints[0]); i++ )
+        WriteAttribute( root, ints[i].name, H5T_NATIVE_INT32, &ints[i].value );
+    WriteAttribute( root, "exposure-ms", H5T_NATIVE_DOUBLE, &header.exposureMs );
+    WriteAttribute( root, "adc-mhz", H5T_NATIVE_DOUBLE, &header.adcMHz );
+    WriteAttribute( root, "start-time-ns", H5T_NATIVE_INT64, &header.startTime );
+    H5Gclose( root );
+
+    hsize_t frameShape[] = { (hsize_t)header.rows, (hsize_t)header.cols };
+    hsize_t spectrumShape[] = { (hsize_t)header.rows, (hsize_t)header.spectrumCols };
+    if( header.contents & RecordFrames )
+        frames = CreateDataset( file, "frames", floatFrames ? H5T_NATIVE_FLOAT : H5T_NATIVE_UINT16, 3, frameShape, true );
+    if( header.contents & RecordSpectra )
+    {
+        hid_t group = H5Gcreate2( file, "spectra", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
+        real = CreateDataset( group, "real", H5T_NATIVE_FLOAT, 3, spectrumShape, true );
+        imag = CreateDataset( group, "imag", H5T_NATIVE_FLOAT, 3, spectrumShape, true );
+        H5Gclose( group );
+    }
+    hid_t group = H5Gcreate2( file, "shots", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
+    numbers = CreateDataset( group, "number", H5T_NATIVE_INT64, 1, NULL, false );
+    timestamps = CreateDataset( group, "timestamp", H5T_NATIVE_INT64, 1, NULL, false );
+    H5Gclose( group );
+
+    if( numbers < 0 || timestamps < 0 || ( header.contents & RecordFrames && frames < 0 )
+        || ( header.contents & RecordSpectra && ( real < 0 || imag < 0 ) ) )
+    {
+        std::cout << "Cannot create the datasets in " << path << "\n";
+        CloseDatasets();
+        return false;
+    }
+
+    freeSlots.clear();
+    queued.clear();
+    for( size_t s = 0; s < slots.size(); s++ )
+    {
+        if( header.contents & RecordFrames )
+            slots[s].frame.resize( (size_t)header.rows * header.cols * pixelBytes );
+        if( header.contents & RecordSpectra )
+        {
+            slots[s].real.resize( (size_t)header.rows * header.spectrumCols );
+            slots[s].imag.resize( (size_t)header.rows * header.spectrumCols );
+        }
+        freeSlots.push_back( &slots[s] );
+    }
+
+    allocated = 0;
+    shots = 0;
+    failed = false;
+    closing = false;
+    writer = std::thread( &Hdf5Writer::WriterLoop, this );
+    return true;
+}
+
+hid_t Hdf5Writer::CreateDataset(hid_t parent, const char* name, hid_t type, int rank, const hsize_t* shape, bool compress)
+{
+    // first dimension is the shot, the rest is one shot
+    hsize_t dims[3], maxDims[3], chunk[3];
+    dims[0] = 0;
+    maxDims[0] = H5S_UNLIMITED;
+    chunk[0] = rank == 1 ? SHOT_LIST_CHUNK : 1;
+    for( int d = 1; d < rank; d++ )
+        dims[d] = maxDims[d] = chunk[d] = shape[d - 1];
+
+    hid_t space = H5Screate_simple( rank, dims, maxDims );
+    hid_t properties = H5Pcreate( H5P_DATASET_CREATE );
+    H5Pset_chunk( properties, rank, chunk );
+    if( compress && compressFilter )
+    {
+        H5Pset_shuffle( properties );
+        if( compressFilter == H5Z_FILTER_DEFLATE )
+            H5Pset_deflate( properties, compressLevel );
+        else
+            H5Pset_filter( properties, compressFilter, H5Z_FLAG_OPTIONAL, 0, NULL );
+    }
+    hid_t dataset = H5Dcreate2( parent, name, type, space, H5P_DEFAULT, properties, H5P_DEFAULT );
+    H5Pclose( properties );
+    H5Sclose( space );
+    return dataset;
+}
+
+void Hdf5Writer::Grow(hsize_t size)
+{
+    hid_t datasets[] = { frames, real, imag, numbers, timestamps };
+    for( size_t i = 0; i < sizeof(datasets) / sizeof(datasets[0]); i++ )
+    {
+        if( datasets[i] < 0 )
+            continue;
+        hsize_t dims[3];
+        hid_t space = H5Dget_space( datasets[i] );
+        H5Sget_simple_extent_dims( space, dims, NULL );
+        H5Sclose( space );
+        dims[0] = size;
+        H5Dset_extent( datasets[i], dims );
+    }
+    allocated = size;
+}
+
+bool Hdf5Writer::Append(hid_t dataset, int rank, const void* data)
+{
+    hsize_t dims[3], start[3] = { shots, 0, 0 };
+    hid_t fileSpace = H5Dget_space( dataset );
+    H5Sget_simple_extent_dims( fileSpace, dims, NULL );
+    dims[0] = 1;
+    H5Sselect_hyperslab( fileSpace, H5S_SELECT_SET, start, NULL, dims, NULL );
+    hid_t memorySpace = H5Screate_simple( rank, dims, NULL );
+    hid_t type = H5Dget_type( dataset );
+    herr_t status = H5Dwrite( dataset, type, memorySpace, fileSpace, H5P_DEFAULT, data );
+    H5Tclose( type );
+    H5Sclose( memorySpace );
+    H5Sclose( fileSpace );
+    return status >= 0;
+}
+
+bool Hdf5Writer::Write(long long number, Clock::time_point acquired,
+                       const uint16_t* frame, size_t frameStride,
+                       const float* realPlane, const float* imagPlane, size_t spectrumStride)
+{
+    return WriteShot( number, acquired, frame, sizeof(uint16_t), frameStride, realPlane, imagPlane, spectrumStride );
+}
+
+bool Hdf5Writer::Write(long long number, Clock::time_point acquired,
+                       const float* frame, size_t frameStride,
+                       const float* realPlane, const float* imagPlane, size_t spectrumStride)
+{
+    return WriteShot( number, acquired, frame, sizeof(float), frameStride, realPlane, imagPlane, spectrumStride );
+}
+
+bool Hdf5Writer::WriteShot(long long number, Clock::time_point acquired,
+                           const void* frame, size_t framePixelBytes, size_t frameStride,
+                           const float* realPlane, const float* imagPlane, size_t spectrumStride)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    if( !IsOpen() || failed )
+        return false;
+    if( header.contents & RecordFrames && framePixelBytes != pixelBytes )
+    {
+        std::cout << "Frame pixels do not match " << path << ", not writing\n";
+        return false;
+    }
+    if( freeSlots.empty() )
+    {
+        Clock::time_point start = Clock::now();
+        while( freeSlots.empty() )
+            slotFree.wait( guard );
+        waits++;
+        waitSeconds += std::chrono::duration<double>( Clock::now() - start ).count();
+    }
+    Slot* slot = freeSlots.front();
+    freeSlots.pop_front();
+    guard.unlock();
+
+    slot->number = number;
+    slot->timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>( acquired - opened ).count();
+    if( header.contents & RecordFrames )
+        for( int r = 0; r < header.rows; r++ )
+            memcpy( &slot->frame[(size_t)r * header.cols * pixelBytes], (const char*)frame + r * frameStride * pixelBytes,
+                    header.cols * pixelBytes );
+    if( header.contents & RecordSpectra )
+        for( int r = 0; r < header.rows; r++ )
+        {
+            memcpy( &slot->real[(size_t)r * header.spectrumCols], realPlane + r * spectrumStride, header.spectrumCols * sizeof(float) );
+            memcpy( &slot->imag[(size_t)r * header.spectrumCols], imagPlane + r * spectrumStride, header.spectrumCols * sizeof(float) );
+        }
+
+    guard.lock();
+    queued.push_back( slot );
+    wake.notify_one();
+    return true;
+}
+
+void Hdf5Writer::WriterLoop()
+{
+    for( ;; )
+    {
+        Slot* slot;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while( queued.empty() && !closing )
+                wake.wait( guard );
+            if( queued.empty() )
+                return;
+            slot = queued.front();
+            queued.pop_front();
+        }
+
+        Clock::time_point start = Clock::now();
+        if( shots == allocated )
+            Grow( allocated + GROW_SHOTS );
+        bool ok = Append( numbers, 1, &slot->number ) && Append( timestamps, 1, &slot->timestamp );
+        if( frames >= 0 )
+            ok = ok && Append( frames, 3, &slot->frame[0] );
+        if( real >= 0 )
+            ok = ok && Append( real, 3, &slot->real[0] ) && Append( imag, 3, &slot->imag[0] );
+        double seconds = std::chrono::duration<double>( Clock::now() - start ).count();
+
+        std::lock_guard<std::mutex> guard(lock);
+        writeSeconds += seconds;
+        if( ok )
+            shots++;
+        if( !ok && !failed )
+        {
+            std::cout << "Writing to " << path << " failed, dropping further shots\n";
+            failed = true;
+        }
+        freeSlots.push_back( slot );
+        slotFree.notify_one();
+    }
+}
+
+void Hdf5Writer::Close()
+{
+    if( !writer.joinable() )
+    {
+        CloseDatasets();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        closing = true;
+        wake.notify_all();
+    }
+    writer.join();
+
+    Grow( shots );                  // trim the last block to what was written
+    CloseDatasets();
+}
+
+void Hdf5Writer::CloseDatasets()
+{
+    hid_t* datasets[] = { &frames, &real, &imag, &numbers, &timestamps };
+    for( size_t i = 0; i < sizeof(datasets) / sizeof(datasets[0]); i++ )
+    {
+        if( *datasets[i] >= 0 )
+            H5Dclose( *datasets[i] );
+        *datasets[i] = -1;
+    }
+    if( file >= 0 )
+        H5Fclose( file );
+    file = -1;
+}
+
+void Hdf5Writer::PrintStatistics() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    std::ios state( NULL );
+    state.copyfmt( std::cout );
+    double megabytes = shots * ( (double)header.rows * header.cols * pixelBytes * !!(header.contents & RecordFrames)
+                               + 2.0 * header.rows * header.spectrumCols * sizeof(float) * !!(header.contents & RecordSpectra) ) / 1e6;
+    std::cout << "HDF5: " << shots << " shots to " << path
+              << std::fixed << std::setprecision(1)
+              << ", " << megabytes << " MB before compression, "
+              << ( writeSeconds > 0 ? megabytes / writeSeconds : 0.0 ) << " MB/s while writing\n"
+              << std::setprecision(3)
+              << "    acquisition waited for the disk " << waits << " time(s), " << waitSeconds << " s"
+              << std::endl;
+    std::cout.copyfmt( state );
+}
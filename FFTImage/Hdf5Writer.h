@@ -0,0 +1,109 @@
+// HDF5 output for long FFTimage runs.
+//
+// Every shot is appended to extendable datasets, chunked one shot per
+// chunk so any shot can be read back without touching the others:
+//
+//     /frames            uint16   shots x rows x cols (float32 band means
+//                                 with RecordFloatFrames)
+//     /spectra/real      float32  shots x rows x spectrumCols
+//     /spectra/imag      float32  shots x rows x spectrumCols
+//     /shots/number      int64    acquisition order of each shot
+//     /shots/timestamp   int64    ns after the file was opened
+//
+// with the recording header fields (geometry, exposure, ADC rate) as
+// attributes of the root group.  Chunks can go through the shuffle filter
+// and deflate, or LZ4 when the HDF5 LZ4 plugin is installed.
+//
+// Write() only copies the shot into one of a fixed set of buffers; a
+// background thread does the compression and the HDF5 calls, so disk
+// time overlaps with acquisition.  When every buffer is waiting for the
+// disk, Write() waits too and the time is counted, which shows whether
+// the disk keeps up.  The datasets grow a block of shots at a time and
+// are trimmed to the shots actually written on Close().
+
+#ifndef HDF5WRITER_H
+#define HDF5WRITER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <hdf5.h>
+#include "RecordFile.h"
+
+class Hdf5Writer
+{
+public:
+    explicit Hdf5Writer(int bufferedShots = 16);
+    ~Hdf5Writer();
+
+    // compression is "none", "deflate", "deflate:<level>" or "lz4"; the
+    // header says which of frames and spectra to store
+    bool Open(const std::string& path, const RecordHeader& header, const std::string& compression);
+    void Close();                   // writes out everything queued
+    bool IsOpen() const { return file >= 0; }
+
+    // Same arguments as RecordWriter::Write.
+    bool Write(long long number, std::chrono::steady_clock::time_point acquired,
+               const uint16_t* frame, size_t frameStride,
+               const float* real, const float* imag, size_t spectrumStride);
+    bool Write(long long number, std::chrono::steady_clock::time_point acquired,
+               const float* frame, size_t frameStride,
+               const float* real, const float* imag, size_t spectrumStride);
+
+    void PrintStatistics() const;
+
+private:
+    struct Slot
+    {
+        int64_t number;
+        int64_t timestamp;
+        std::vector<char> frame;    // uint16 or float pixels
+        std::vector<float> real;
+        std::vector<float> imag;
+    };
+
+    Hdf5Writer(const Hdf5Writer&);
+    Hdf5Writer& operator=(const Hdf5Writer&);
+
+    bool WriteShot(long long number, std::chrono::steady_clock::time_point acquired,
+                   const void* frame, size_t framePixelBytes, size_t frameStride,
+                   const float* real, const float* imag, size_t spectrumStride);
+    hid_t CreateDataset(hid_t parent, const char* name, hid_t type, int rank, const hsize_t* shape, bool compress);
+    bool Append(hid_t dataset, int rank, const void* data);
+    void Grow(hsize_t shots);
+    void WriterLoop();
+    void CloseDatasets();
+
+    RecordHeader header;
+    size_t pixelBytes;
+    std::string path;
+    std::chrono::steady_clock::time_point opened;
+
+    hid_t file;
+    hid_t frames, real, imag, numbers, timestamps;
+    int compressFilter;             // H5Z filter id, 0 for none
+    unsigned compressLevel;
+    hsize_t allocated;              // shots the datasets currently have room for
+    hsize_t shots;                  // shots written so far
+    bool failed;
+
+    std::vector<Slot> slots;
+    std::deque<Slot*> freeSlots;
+    std::deque<Slot*> queued;
+    bool closing;
+    std::thread writer;
+    mutable std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable slotFree;
+
+    long long waits;                // Write() calls that found no free buffer
+    double waitSeconds;
+    double writeSeconds;            // background thread busy in HDF5
+};
+
+#endif
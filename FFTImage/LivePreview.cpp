@@ -0,0 +1,157 @@
+#include "LivePreview.h"
+
+#include <algorithm>
+#include <iostream>
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/highgui/highgui.hpp"
+
+LivePreview::LivePreview(const std::string& window, double rate, int maxWidth)
+    : window(window),
+      interval(std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( 1.0 / rate ) )),
+      maxWidth(maxWidth),
+      fresh(false),
+      quit(false),
+      running(false),
+      key(-1),
+      offered(0),
+      copied(0),
+      busy(0),
+      shown(0)
+{
+}
+
+LivePreview::~LivePreview()
+{
+    Stop();
+}
+
+void LivePreview::Start()
+{
+    if( running )
+        return;
+    quit = false;
+    running = true;
+    nextDue = Clock::now();
+    thread = std::thread( &LivePreview::Loop, this );
+}
+
+void LivePreview::Stop()
+{
+    if( !running )
+        return;
+    {
+        std::lock_guard<std::mutex> guard( lock );
+        quit = true;
+    }
+    wake.notify_all();
+    keyPressed.notify_all();
+    thread.join();
+    running = false;
+}
+
+void LivePreview::Offer(const cv::Mat& frame, bool last)
+{
+    offered++;
+    Clock::time_point now = Clock::now();
+    if( !running || ( now < nextDue && !last ) )
+        return;
+
+    // the preview thread only holds the lock to swap buffers
+    std::unique_lock<std::mutex> guard( lock, std::try_to_lock );
+    if( !guard.owns_lock() && last )
+        guard.lock();
+    if( !guard.owns_lock() )
+    {
+        busy++;
+        return;
+    }
+    frame.copyTo( pending );
+    fresh = true;
+    nextDue = now + interval;
+    guard.unlock();
+    copied++;
+    wake.notify_one();
+}
+
+int LivePreview::WaitForKey()
+{
+    std::unique_lock<std::mutex> guard( lock );
+    if( !running )
+        return -1;
+    key = -1;
+    while( key < 0 && !quit )
+        keyPressed.wait( guard );
+    return key;
+}
+
+void LivePreview::Render(const cv::Mat& frame, cv::Mat& out)
+{
+    if( frame.cols > maxWidth )
+    {
+        double scale = (double)maxWidth / frame.cols;
+        cv::resize( frame, small, cv::Size(), scale, scale, cv::INTER_AREA );
+    }
+    else
+        small = frame;
+
+    samples.clear();
+    for( int r = 0; r < small.rows; r++ )
+        samples.insert( samples.end(), small.ptr<unsigned short>(r), small.ptr<unsigned short>(r) + small.cols );
+    size_t lowIndex = samples.size() / 200;
+    size_t highIndex = samples.size() - 1 - samples.size() / 200;
+    std::nth_element( samples.begin(), samples.begin() + lowIndex, samples.end() );
+    double low = samples[lowIndex];
+    std::nth_element( samples.begin(), samples.begin() + highIndex, samples.end() );
+    double high = std::max( (double)samples[highIndex], low + 1 );
+
+    small.convertTo( out, CV_8U, 255.0 / ( high - low ), -low * 255.0 / ( high - low ) );
+}
+
+void LivePreview::Loop()
+{
+    cv::namedWindow( window, cv::WINDOW_AUTOSIZE );
+    while( true )
+    {
+        bool show = false;
+        {
+            std::unique_lock<std::mutex> guard( lock );
+            wake.wait_for( guard, interval, [this] { return fresh || quit; } );
+            if( quit )
+                break;
+            if( fresh )
+            {
+                cv::swap( pending, current );
+                fresh = false;
+                show = true;
+            }
+        }
+        if( show )
+        {
+            Render( current, display );
+            cv::imshow( window, display );
+            shown++;
+        }
+
+        // also runs the GUI event loop
+        int pressed = cv::waitKey( 1 );
+        // a closed window takes no more keys, so it counts as Esc; not
+        // while a frame is pending, whose imshow opens it again
+        bool closed = shown > 0 && cv::getWindowProperty( window, cv::WND_PROP_VISIBLE ) < 1;
+        if( pressed >= 0 || closed )
+        {
+            std::lock_guard<std::mutex> guard( lock );
+            if( pressed >= 0 )
+                key = pressed;
+            else if( !fresh )
+                key = PREVIEW_CLOSED_KEY;
+            keyPressed.notify_all();
+        }
+    }
+    cv::destroyWindow( window );
+}
+
+void LivePreview::PrintStatistics() const
+{
+    std::cout << "Preview: " << shown << " of " << offered << " frames shown, "
+              << copied << " copied, " << busy << " skipped while the display was busy" << std::endl;
+}
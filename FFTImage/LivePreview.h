@@ -0,0 +1,80 @@
+// Live display of the camera frames, off the acquisition path.
+//
+// imshow() plus waitKey() in the acquisition loop stalls the camera for
+// as long as the GUI takes, or until a key is pressed.  LivePreview owns
+// the window on a thread of its own.  Offer() hands it the latest frame:
+// frames arriving faster than the refresh rate are dropped after a clock
+// read, and a frame is only copied when the display is due and the
+// preview thread is not holding the buffer, so the caller never waits on
+// the GUI.  The preview thread shrinks the frame to the window width and
+// maps the 16-bit counts to 8 bits between the 0.5th and 99.5th
+// percentiles, so one cosmic ray does not wash out the picture.
+
+#ifndef LIVEPREVIEW_H
+#define LIVEPREVIEW_H
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#define PREVIEW_CLOSED_KEY  27      // Esc
+
+class LivePreview
+{
+public:
+    // at most rate frames per second, shrunk to at most maxWidth pixels
+    LivePreview(const std::string& window, double rate, int maxWidth);
+    ~LivePreview();
+
+    void Start();
+    void Stop();
+
+    // CV_16U frame; call from one thread at a time.  last skips the rate
+    // limit, for a final frame that must not be dropped.
+    void Offer(const cv::Mat& frame, bool last = false);
+
+    // Block until a key is pressed in the window (for when acquisition
+    // is over); returns the key, PREVIEW_CLOSED_KEY if the window has been
+    // closed, or -1 if the preview is not running.
+    int WaitForKey();
+
+    void PrintStatistics() const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    void Loop();
+    void Render(const cv::Mat& frame, cv::Mat& display);
+
+    std::string window;
+    Clock::duration interval;
+    int maxWidth;
+
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable keyPressed;
+    cv::Mat pending;                // latest offered frame, under lock
+    bool fresh;
+    bool quit;
+    bool running;
+    int key;
+    Clock::time_point nextDue;      // Offer() only
+
+    cv::Mat current;                // preview thread only
+    cv::Mat small;
+    cv::Mat display;
+    std::vector<unsigned short> samples;
+
+    std::atomic<long long> offered;
+    std::atomic<long long> copied;
+    std::atomic<long long> busy;
+    long long shown;
+};
+
+#endif
@@ -0,0 +1,115 @@
+#include "LocalSocket.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define MAX_LINE  4096
+
+static bool MakeAddress(const std::string& path, sockaddr_un* address)
+{
+    memset( address, 0, sizeof(*address) );
+    address->sun_family = AF_UNIX;
+    if( path.size() >= sizeof(address->sun_path) )
+    {
+        std::cout << "Socket path " << path << " is too long\n";
+        return false;
+    }
+    strcpy( address->sun_path, path.c_str() );
+    return true;
+}
+
+int ListenLocal(const std::string& path)
+{
+    sockaddr_un address;
+    if( !MakeAddress( path, &address ) )
+        return -1;
+
+    int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if( fd < 0 )
+        return -1;
+    unlink( path.c_str() );
+    if( bind( fd, (sockaddr*)&address, sizeof(address) ) != 0 || listen( fd, 4 ) != 0 )
+    {
+        std::cout << "Cannot listen on " << path << ": " << strerror( errno ) << "\n";
+        close( fd );
+        return -1;
+    }
+    return fd;
+}
+
+int ConnectLocal(const std::string& path)
+{
+    sockaddr_un address;
+    if( !MakeAddress( path, &address ) )
+        return -1;
+
+    int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if( fd < 0 )
+        return -1;
+    if( connect( fd, (sockaddr*)&address, sizeof(address) ) != 0 )
+    {
+        std::cout << "Cannot connect to " << path << ": " << strerror( errno ) << "\n";
+        close( fd );
+        return -1;
+    }
+    return fd;
+}
+
+bool SendAll(int fd, const void* data, size_t bytes)
+{
+    const char* p = (const char*)data;
+    while( bytes > 0 )
+    {
+        ssize_t sent = send( fd, p, bytes, MSG_NOSIGNAL );
+        if( sent < 0 && errno == EINTR )
+            continue;
+        if( sent <= 0 )
+            return false;
+        p += sent;
+        bytes -= sent;
+    }
+    return true;
+}
+
+bool ReceiveAll(int fd, void* data, size_t bytes)
+{
+    char* p = (char*)data;
+    while( bytes > 0 )
+    {
+        ssize_t got = recv( fd, p, bytes, 0 );
+        if( got < 0 && errno == EINTR )
+            continue;
+        if( got <= 0 )
+            return false;
+        p += got;
+        bytes -= got;
+    }
+    return true;
+}
+
+bool SendLine(int fd, const std::string& line)
+{
+    std::string text = line + "\n";
+    return SendAll( fd, text.data(), text.size() );
+}
+
+bool ReceiveLine(int fd, std::string* line)
+{
+    // a byte at a time, so nothing after the line is consumed; the lines
+    // are short and few
+    line->clear();
+    char c;
+    while( ReceiveAll( fd, &c, 1 ) )
+    {
+        if( c == '\n' )
+            return true;
+        if( line->size() >= MAX_LINE )
+            return false;
+        *line += c;
+    }
+    return false;
+}
@@ -0,0 +1,31 @@
+// Unix domain socket helpers shared by the acquisition daemon (pylond)
+// and its client (pylonjob).
+//
+// Requests and replies are text lines; a job's shots follow its reply
+// line as a recording (RecordFile.h) written straight onto the socket,
+// and end with a RecordEntry whose number is RECORD_STREAM_END.
+
+#ifndef LOCALSOCKET_H
+#define LOCALSOCKET_H
+
+#include <stddef.h>
+#include <string>
+
+#define DEFAULT_SOCKET      "/tmp/pylond.sock"
+#define RECORD_STREAM_END   -1
+
+// Listening socket at path (replacing a stale one), or -1.
+int ListenLocal(const std::string& path);
+
+// Connected socket, or -1.
+int ConnectLocal(const std::string& path);
+
+// Send or receive exactly bytes; false on error or end of stream.
+bool SendAll(int fd, const void* data, size_t bytes);
+bool ReceiveAll(int fd, void* data, size_t bytes);
+
+// One line, sent with or received without its '\n'.
+bool SendLine(int fd, const std::string& line);
+bool ReceiveLine(int fd, std::string* line);
+
+#endif
@@ -0,0 +1,215 @@
+#include "Pipeline.h"
+
+#include <cstring>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+
+// An idle stage yields a few times, then naps, rather than spinning a core
+// flat out waiting for the camera.
+#define BACKOFF_YIELDS     16
+#define BACKOFF_SLEEP_US   100
+
+typedef std::chrono::steady_clock Clock;
+
+static void Backoff(int& spins)
+{
+    if( ++spins < BACKOFF_YIELDS )
+        std::this_thread::yield();
+    else
+        std::this_thread::sleep_for( std::chrono::microseconds(BACKOFF_SLEEP_US) );
+}
+
+Pipeline::Pipeline(FrameStream* stream, int slots, int processThreads, Backpressure backpressure,
+                   ProcessFunction process, WriteFunction write)
+    : stream(stream),
+      processThreads(processThreads < 1 ? 1 : processThreads),
+      backpressure(backpressure),
+      process(process),
+      write(write),
+      times(NULL),
+      slots(slots < 2 ? 2 : slots),
+      freeSlots(this->slots.size()),
+      processQueue(this->slots.size()),
+      writeQueue(this->slots.size()),
+      acquisitionDone(false),
+      processingDone(false),
+      acquired(0),
+      written(0),
+      droppedBeforeProcessing(0),
+      droppedBeforeWriting(0),
+      stalls(0),
+      stallSeconds(0),
+      runSeconds(0)
+{
+    // every queue can hold every slot, so only the free list ever runs dry
+    for( size_t s = 0; s < this->slots.size(); s++ )
+    {
+        this->slots[s].readout.resize( stream->FrameBytes() );
+        freeSlots.TryPush( &this->slots[s] );
+    }
+}
+
+void Pipeline::Run(long long numShots)
+{
+    Clock::time_point start = Clock::now();
+    acquisitionDone = false;
+    processingDone = false;
+
+    std::thread writer( &Pipeline::WriterLoop, this );
+    std::vector<std::thread> workers;
+    for( int t = 0; t < processThreads; t++ )
+        workers.push_back( std::thread(&Pipeline::ProcessLoop, this, t) );
+    std::thread acquisition( &Pipeline::AcquisitionLoop, this, numShots );
+
+    acquisition.join();
+    for( size_t t = 0; t < workers.size(); t++ )
+        workers[t].join();
+    processingDone = true;
+    writer.join();
+
+    runSeconds = std::chrono::duration<double>( Clock::now() - start ).count();
+}
+
+Shot* Pipeline::TakeSlot()
+{
+    Shot* shot;
+    if( freeSlots.TryPop( shot ) )
+        return shot;
+
+    Clock::time_point start = Clock::now();
+    int spins = 0;
+    for( ;; )
+    {
+        if( freeSlots.TryPop( shot ) )
+            break;
+        if( backpressure == DropOldest )
+        {
+            // the shots waiting for the writer are the oldest in flight
+            if( writeQueue.TryPop( shot ) )
+            {
+                droppedBeforeWriting++;
+                break;
+            }
+            if( processQueue.TryPop( shot ) )
+            {
+                droppedBeforeProcessing++;
+                break;
+            }
+        }
+        Backoff( spins );
+    }
+    stalls++;
+    stallSeconds += std::chrono::duration<double>( Clock::now() - start ).count();
+    return shot;
+}
+
+void Pipeline::AcquisitionLoop(long long numShots)
+{
+    for( long long n = 0; n < numShots; n++ )
+    {
+        Clock::time_point mark = Clock::now();
+        FrameHandle frame;
+        if( !stream->Pop( frame ) )
+            break;
+        MarkStage( times, StageAcquire, mark );
+
+        Shot* shot = TakeSlot();
+        shot->number = n;
+        shot->timestamp = Clock::now();
+        memcpy( &shot->readout[0], frame.Data(), shot->readout.size() );
+        frame.Release();
+        if( times )
+            times->Mark( StageCopy, shot->timestamp );
+        acquired++;
+
+        int spins = 0;
+        while( !processQueue.TryPush( shot ) )
+            Backoff( spins );
+    }
+    acquisitionDone = true;
+}
+
+void Pipeline::ProcessLoop(int worker)
+{
+    int spins = 0;
+    for( ;; )
+    {
+        // read the flag first: if acquisition was already done, an empty
+        // queue really is the end
+        bool done = acquisitionDone;
+        Shot* shot;
+        if( !processQueue.TryPop( shot ) )
+        {
+            if( done )
+                return;
+            Backoff( spins );
+            continue;
+        }
+        spins = 0;
+
+        process( worker, *shot );
+
+        while( !writeQueue.TryPush( shot ) )
+            Backoff( spins );
+        spins = 0;
+    }
+}
+
+void Pipeline::WriterLoop()
+{
+    int spins = 0;
+    for( ;; )
+    {
+        bool done = processingDone;
+        Shot* shot;
+        if( !writeQueue.TryPop( shot ) )
+        {
+            if( done )
+                return;
+            Backoff( spins );
+            continue;
+        }
+        spins = 0;
+
+        write( *shot );
+        written++;
+
+        while( !freeSlots.TryPush( shot ) )
+            Backoff( spins );
+        spins = 0;
+    }
+}
+
+void Pipeline::PrintStatistics() const
+{
+    std::ios state( NULL );
+    state.copyfmt( std::cout );
+    std::cout << "Pipeline: " << slots.size() << " slots, " << processThreads << " processing thread(s), "
+              << ( backpressure == Block ? "block" : "drop-oldest" ) << " when full\n"
+              << "    " << acquired << " shots acquired, " << written << " written, "
+              << Dropped() << " dropped (" << droppedBeforeProcessing << " before processing, "
+              << droppedBeforeWriting << " before writing)\n"
+              << std::fixed << std::setprecision(1)
+              << "    acquire -> process queue: max depth " << processQueue.MaxDepth()
+              << ", mean " << processQueue.MeanDepth() << "\n"
+              << "    process -> write queue:   max depth " << writeQueue.MaxDepth()
+              << ", mean " << writeQueue.MeanDepth() << "\n"
+              << std::setprecision(3)
+              << "    acquisition waited for a slot " << stalls << " time(s), "
+              << stallSeconds << " s of " << runSeconds << " s"
+              << std::endl;
+    std::cout.copyfmt( state );
+}
+
+bool Pipeline::ParseBackpressure(const std::string& text, Backpressure* policy)
+{
+    if( text == "block" )
+        *policy = Block;
+    else if( text == "drop-oldest" )
+        *policy = DropOldest;
+    else
+        return false;
+    return true;
+}
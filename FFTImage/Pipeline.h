@@ -0,0 +1,110 @@
+// Staged acquire -> process -> write pipeline for FFTimage.
+//
+// Run() starts an acquisition thread that pops readouts off a FrameStream,
+// a pool of processing threads and a writer thread, connected by bounded
+// lock-free RingQueues.  Shots travel through the stages in a fixed set of
+// slots, each holding a copy of the readout and the spectrum computed from
+// it; the caller preallocates each slot's outputs (Slots()), so nothing is
+// allocated per shot.
+//
+// The copy is deliberate: PICam may overwrite a readout as soon as the
+// stream asks for the next update, so a frame handle cannot be held for
+// as long as a shot spends in the pipeline without stalling the camera.
+// The acquisition thread copies each readout into its slot and releases
+// the handle straight away; a slow writer (disk, display) then only ever
+// holds on to slots.
+//
+// When every slot is in flight the acquisition thread either waits for
+// one to come back (Block: the pipeline loses nothing, but the camera's
+// circular buffer fills and the camera may report lost data) or takes
+// back the oldest shot still sitting in a queue (DropOldest: the shot is
+// counted as dropped and its slot reused).  Processing threads finish in
+// any order, so the writer can see shots out of sequence; Shot::number is
+// the order they were acquired in.
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <opencv2/core/core.hpp>
+#include "FrameStream.h"
+#include "RingQueue.h"
+#include "StageProfile.h"
+#include "FFTWorkspace.h"
+
+struct Shot
+{
+    Shot() : number(0), buffers(NULL) {}
+
+    long long number;
+    std::chrono::steady_clock::time_point timestamp;    // when the readout was popped
+    std::vector<pibyte> readout;    // copy of one readout, FrameBytes() long
+    cv::Mat binned;                 // the ROI averaged into one float row, if binning
+    cv::Mat spectrum[2];            // Re(DFT), Im(DFT) of the ROI rows
+    cv::Mat tracked;                // rows x tracked bins, CV_64FC2
+    FFTWorkspace* buffers;          // where the Mats above are preallocated
+};
+
+class Pipeline
+{
+public:
+    enum Backpressure { Block, DropOldest };
+
+    // process runs on processing thread worker (0 .. processThreads-1) and
+    // fills shot.spectrum; write runs on the writer thread
+    typedef std::function<void(int worker, Shot& shot)> ProcessFunction;
+    typedef std::function<void(Shot& shot)> WriteFunction;
+
+    Pipeline(FrameStream* stream, int slots, int processThreads, Backpressure backpressure,
+             ProcessFunction process, WriteFunction write);
+
+    // Push numShots shots through every stage; returns once the writer is
+    // done with the last one or the stream has stopped.
+    void Run(long long numShots);
+
+    // time the acquisition thread's stages, if set; before Run()
+    void SetTimes(StageTimes* acquisition) { times = acquisition; }
+
+    // the shots in flight, to preallocate what processing fills in before Run()
+    std::vector<Shot>& Slots() { return slots; }
+
+    long long Dropped() const { return droppedBeforeProcessing + droppedBeforeWriting; }
+    void PrintStatistics() const;
+
+    static bool ParseBackpressure(const std::string& text, Backpressure* policy);
+
+private:
+    void AcquisitionLoop(long long numShots);
+    void ProcessLoop(int worker);
+    void WriterLoop();
+    Shot* TakeSlot();
+
+    FrameStream* stream;
+    int processThreads;
+    Backpressure backpressure;
+    ProcessFunction process;
+    WriteFunction write;
+    StageTimes* times;
+
+    std::vector<Shot> slots;
+    RingQueue<Shot*> freeSlots;
+    RingQueue<Shot*> processQueue;      // acquired, waiting for a processing thread
+    RingQueue<Shot*> writeQueue;        // processed, waiting for the writer
+
+    std::atomic<bool> acquisitionDone;
+    std::atomic<bool> processingDone;
+
+    std::atomic<long long> acquired;
+    std::atomic<long long> written;
+    std::atomic<long long> droppedBeforeProcessing;
+    std::atomic<long long> droppedBeforeWriting;
+    long long stalls;                   // shots that had to wait for a free slot
+    double stallSeconds;
+    double runSeconds;
+};
+
+#endif
@@ -0,0 +1,188 @@
+#include "PixelFilter.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+PixelFilter::PixelFilter(int rows, int cols, Test test, int history, int threshold)
+    : rows(rows),
+      cols(cols),
+      test(test),
+      history(std::max(1, history)),
+      threshold(threshold),
+      current((size_t)rows * cols),
+      cleaned((size_t)rows * cols),
+      pastCount(0),
+      pastNext(0),
+      reference(cols),
+      shots(0),
+      replaced(0)
+{
+    if( test == Median )
+    {
+        past.resize( (size_t)this->history * rows * cols );
+        scratch.resize( (size_t)this->history * cols );
+    }
+}
+
+void PixelFilter::LocalReference(const uint16_t* frame, int r, uint16_t* out) const
+{
+    if( rows > 1 )
+    {
+        const uint16_t* up = frame + (size_t)( r > 0 ? r - 1 : r + 1 ) * cols;
+        const uint16_t* down = frame + (size_t)( r < rows - 1 ? r + 1 : r - 1 ) * cols;
+        for( int c = 0; c < cols; c++ )
+            out[c] = (uint16_t)( ( (unsigned)up[c] + down[c] + 1 ) >> 1 );
+    }
+    else
+    {
+        const uint16_t* x = frame + (size_t)r * cols;
+        out[0] = x[cols > 1 ? 1 : 0];
+        for( int c = 1; c < cols - 1; c++ )
+            out[c] = (uint16_t)( ( (unsigned)x[c - 1] + x[c + 1] + 1 ) >> 1 );
+        if( cols > 1 )
+            out[cols - 1] = x[cols - 2];
+    }
+}
+
+void PixelFilter::ReplaceHotPixels(uint16_t* frame) const
+{
+    // scalar: the list is short and scattered
+    for( size_t i = 0; i < hotPixels.size(); i++ )
+    {
+        int r = hotPixels[i] / cols;
+        int c = hotPixels[i] % cols;
+        unsigned a, b;
+        if( rows > 1 )
+        {
+            a = frame[(size_t)( r > 0 ? r - 1 : r + 1 ) * cols + c];
+            b = frame[(size_t)( r < rows - 1 ? r + 1 : r - 1 ) * cols + c];
+        }
+        else if( cols > 1 )
+        {
+            a = frame[c > 0 ? c - 1 : c + 1];
+            b = frame[c < cols - 1 ? c + 1 : c - 1];
+        }
+        else
+            continue;       // a single pixel has no neighbours to stand in
+        frame[hotPixels[i]] = (uint16_t)( ( a + b + 1 ) >> 1 );
+    }
+}
+
+void PixelFilter::MedianRow(int r, uint16_t* median)
+{
+    for( int k = 0; k < pastCount; k++ )
+        memcpy( &scratch[(size_t)k * cols], &past[( (size_t)k * rows + r ) * cols], cols * sizeof(uint16_t) );
+
+    // odd-even transposition: pastCount rounds of compare-exchange between
+    // neighbouring rows sort every column at once
+    for( int round = 0; round < pastCount; round++ )
+    {
+        for( int k = round & 1; k + 1 < pastCount; k += 2 )
+        {
+            uint16_t* a = &scratch[(size_t)k * cols];
+            uint16_t* b = a + cols;
+            for( int c = 0; c < cols; c++ )
+            {
+                uint16_t lo = std::min( a[c], b[c] );
+                uint16_t hi = std::max( a[c], b[c] );
+                a[c] = lo;
+                b[c] = hi;
+            }
+        }
+    }
+    memcpy( median, &scratch[(size_t)( pastCount / 2 ) * cols], cols * sizeof(uint16_t) );
+}
+
+int PixelFilter::Select(const uint16_t* x, const uint16_t* ref, uint16_t* out) const
+{
+    int count = 0;
+    for( int c = 0; c < cols; c++ )
+    {
+        bool outlier = (int)x[c] - (int)ref[c] > threshold;
+        out[c] = outlier ? ref[c] : x[c];
+        count += outlier;
+    }
+    return count;
+}
+
+const uint16_t* PixelFilter::Clean(const uint16_t* frame, size_t stride)
+{
+    for( int r = 0; r < rows; r++ )
+        memcpy( &current[(size_t)r * cols], frame + r * stride, cols * sizeof(uint16_t) );
+    ReplaceHotPixels( &current[0] );
+    shots++;
+
+    if( test == None )
+        return &current[0];
+
+    bool median = test == Median && pastCount == history;
+    for( int r = 0; r < rows; r++ )
+    {
+        if( median )
+            MedianRow( r, &reference[0] );
+        else
+            LocalReference( &current[0], r, &reference[0] );
+        replaced += Select( &current[(size_t)r * cols], &reference[0], &cleaned[(size_t)r * cols] );
+    }
+
+    // the history keeps the uncleaned shots; the median copes with them
+    if( test == Median )
+    {
+        memcpy( &past[(size_t)pastNext * rows * cols], &current[0], current.size() * sizeof(uint16_t) );
+        pastNext = ( pastNext + 1 ) % history;
+        pastCount = std::min( pastCount + 1, history );
+    }
+    return &cleaned[0];
+}
+
+void PixelFilter::PrintStatistics() const
+{
+    std::cout << "Pixel filter: " << hotPixels.size() << " hot pixels, "
+              << replaced << " outliers replaced in " << shots << " shots" << std::endl;
+}
+
+bool PixelFilter::ParseTest(const std::string& text, Test* test)
+{
+    if( text == "none" )
+        *test = None;
+    else if( text == "median" )
+        *test = Median;
+    else if( text == "local" )
+        *test = Local;
+    else
+        return false;
+    return true;
+}
+
+bool PixelFilter::LoadHotPixels(const std::string& path, const RecordHeader& header, std::vector<int>* pixels)
+{
+    std::ifstream file( path.c_str() );
+    if( !file )
+    {
+        std::cout << "Cannot open hot pixel list " << path << "\n";
+        return false;
+    }
+
+    pixels->clear();
+    std::string line;
+    while( std::getline( file, line ) )
+    {
+        line = line.substr( 0, line.find( '#' ) );
+        int x, y;
+        std::stringstream fields( line );
+        if( !(fields >> x >> y) )
+            continue;
+        // sensor pixel -> read-out frame -> ROI
+        int c = ( x - header.sensorX ) / header.xBinning - header.roiFirstCol;
+        int r = ( y - header.sensorY ) / header.yBinning - header.roiFirstRow;
+        if( x >= header.sensorX && y >= header.sensorY
+            && r >= 0 && r < header.rows && c >= 0 && c < header.cols )
+            pixels->push_back( r * header.cols + c );
+    }
+    std::sort( pixels->begin(), pixels->end() );
+    pixels->erase( std::unique( pixels->begin(), pixels->end() ), pixels->end() );
+    return true;
+}
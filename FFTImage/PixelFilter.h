@@ -0,0 +1,85 @@
+// Hot-pixel and cosmic-ray rejection for FFTimage.
+//
+// A single bright pixel is a delta function along its row, so it shows
+// up as broadband junk across the whole row spectrum.  PixelFilter cleans
+// a copy of the ROI before it is transformed (the recorded frames stay
+// raw):
+//
+//  - pixels on the hot-pixel list are always replaced;
+//  - with the median test, a pixel more than threshold counts above the
+//    median of the same pixel in the last few shots is replaced by that
+//    median;
+//  - with the local test, a pixel more than threshold counts above its
+//    neighbours in the same column is replaced by their mean.  The
+//    fringes run along the rows, so the pixels above and below are the
+//    best estimate of what should be there (with one ROI row, the left
+//    and right neighbours are used instead).
+//
+// The median test falls back to the local one until it has seen enough
+// shots.  Every pass works on whole rows of uint16 with min/max and
+// compare-select only, so the compiler turns them into SIMD loops; the
+// median is an odd-even transposition network over the history rather
+// than a sort.  The history has to see the shots in order, so FFTimage
+// only allows the median test with a single processing thread.
+
+#ifndef PIXELFILTER_H
+#define PIXELFILTER_H
+
+#include "RecordFile.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+class PixelFilter
+{
+public:
+    enum Test { None, Median, Local };
+
+    // history is the number of previous shots the median is taken over
+    PixelFilter(int rows, int cols, Test test, int history, int threshold);
+
+    // indexes into the rows x cols ROI
+    void SetHotPixels(const std::vector<int>& pixels) { hotPixels = pixels; }
+
+    // Clean the rows x cols ROI at frame (stride in pixels).  The result
+    // is contiguous (stride cols) and valid until the next call.
+    const uint16_t* Clean(const uint16_t* frame, size_t stride);
+
+    long long Replaced() const { return replaced; }
+    void PrintStatistics() const;
+
+    static bool ParseTest(const std::string& text, Test* test);
+
+    // Read a list of hot pixels, one "x y" sensor position per line ('#'
+    // starts a comment), and map those inside the ROI described by header
+    // to ROI indexes.
+    static bool LoadHotPixels(const std::string& path, const RecordHeader& header, std::vector<int>* pixels);
+
+private:
+    void ReplaceHotPixels(uint16_t* frame) const;
+    void LocalReference(const uint16_t* frame, int r, uint16_t* reference) const;
+    void MedianRow(int r, uint16_t* median);
+    int Select(const uint16_t* current, const uint16_t* reference, uint16_t* out) const;
+
+    int rows;
+    int cols;
+    Test test;
+    int history;
+    int threshold;
+    std::vector<int> hotPixels;
+
+    std::vector<uint16_t> current;      // raw ROI, hot pixels replaced
+    std::vector<uint16_t> cleaned;
+    std::vector<uint16_t> past;         // history x rows x cols ring
+    int pastCount;
+    int pastNext;
+    std::vector<uint16_t> scratch;      // history x cols, median network
+    std::vector<uint16_t> reference;    // one row
+
+    long long shots;
+    long long replaced;
+};
+
+#endif
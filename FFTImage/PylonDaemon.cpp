@@ -0,0 +1,389 @@
+// Acquisition daemon for the PyLoN.
+//
+// Opening the camera, committing parameters and cooling the sensor to its
+// set point takes seconds to minutes, and every FFTimage or SnapImage run
+// pays for it again.  pylond does it once, keeps the camera open and cold,
+// and takes acquisition jobs over a Unix domain socket (see pylonjob), one
+// connection at a time, one request per line:
+//
+//     status
+//         -> OK temperature=<C> setpoint=<C> jobs=<n> uptime=<s>
+//     acquire shots=N [sensor-roi=x,y,w,h] [bin-x=1] [bin-y=1]
+//             [roi-rows=first:last] [roi-cols=first:last]
+//             [exposure-ms=t] [record=path] [stream=1]
+//         -> OK rows=<r> cols=<c> stream=<0|1>
+//            with stream=1, a recording of the ROI frames (LocalSocket.h)
+//            DONE shots=<n> temperature=<C>
+//         or ERROR <reason>
+//     shutdown
+//         -> OK
+//
+// ROI and exposure are only committed when a job changes them; the set
+// point and ADC speed are set once at startup.  record= writes the same
+// recording to a file on the daemon's side as well.
+
+#include "picam.h"
+#include "FrameStream.h"
+#include "SensorGeometry.h"
+#include "RecordFile.h"
+#include "LocalSocket.h"
+#include "CameraParameters.h"
+
+#include <map>
+#include <sstream>
+#include <iostream>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void OnSignal(int)
+{
+    stopRequested = 1;
+}
+
+struct Daemon
+{
+    PicamHandle camera;
+    CameraParameters* parameters;
+    int circularReadouts;
+    bool verboseOutput;
+    long long jobs;
+    std::chrono::steady_clock::time_point started;
+};
+
+static piflt Temperature(PicamHandle camera)
+{
+    piflt temperature = 0;
+    Picam_GetParameterFloatingPointValue( camera, PicamParameter_SensorTemperatureReading, &temperature );
+    return temperature;
+}
+
+// "acquire shots=10 record=x.rec" -> { shots: 10, record: x.rec }
+static bool ParseFields(std::stringstream& words, std::map<std::string, std::string>* fields, std::string* reason)
+{
+    std::string word;
+    while( words >> word )
+    {
+        size_t equals = word.find( '=' );
+        if( equals == std::string::npos || equals == 0 )
+        {
+            *reason = "expected key=value, got " + word;
+            return false;
+        }
+        (*fields)[word.substr( 0, equals )] = word.substr( equals + 1 );
+    }
+    return true;
+}
+
+static std::string Field(const std::map<std::string, std::string>& fields, const std::string& key, const std::string& otherwise)
+{
+    std::map<std::string, std::string>::const_iterator i = fields.find( key );
+    return i == fields.end() ? otherwise : i->second;
+}
+
+// a whole number above zero, and nothing after it
+static bool ParseCount(const std::string& text, int* value)
+{
+    char* end = NULL;
+    long count = strtol( text.c_str(), &end, 10 );
+    if( text.empty() || *end != '\0' || count <= 0 || count > INT_MAX )
+        return false;
+    *value = (int)count;
+    return true;
+}
+
+// the same for counts that may not fit an int
+static bool ParseCount(const std::string& text, long long* value)
+{
+    char* end = NULL;
+    long long count = strtoll( text.c_str(), &end, 10 );
+    if( text.empty() || *end != '\0' || count <= 0 )
+        return false;
+    *value = count;
+    return true;
+}
+
+// a time of zero or more milliseconds, and nothing after it
+static bool ParseMilliseconds(const std::string& text, double* value)
+{
+    char* end = NULL;
+    double milliseconds = strtod( text.c_str(), &end );
+    if( text.empty() || *end != '\0' || !( milliseconds >= 0 ) )
+        return false;
+    *value = milliseconds;
+    return true;
+}
+
+static void Status(Daemon& daemon, int client)
+{
+    piflt setPoint = 0;
+    Picam_GetParameterFloatingPointValue( daemon.camera, PicamParameter_SensorTemperatureSetPoint, &setPoint );
+    std::stringstream reply;
+    reply << "OK temperature=" << Temperature( daemon.camera ) << " setpoint=" << setPoint
+          << " jobs=" << daemon.jobs << " uptime="
+          << (long long)std::chrono::duration<double>( std::chrono::steady_clock::now() - daemon.started ).count();
+    SendLine( client, reply.str() );
+}
+
+static void Acquire(Daemon& daemon, int client, const std::map<std::string, std::string>& fields)
+{
+    if( !fields.count( "shots" ) )
+    {
+        SendLine( client, "ERROR shots=N is required" );
+        return;
+    }
+    long long shots = 0;
+    if( !ParseCount( Field( fields, "shots", "" ), &shots ) )
+    {
+        SendLine( client, "ERROR cannot parse shots" );
+        return;
+    }
+
+    PicamRoi roi = FullSensorRoi();
+    std::string sensorRoi = Field( fields, "sensor-roi", "" );
+    if( !sensorRoi.empty() && !ParseSensorRoi( sensorRoi.c_str(), &roi ) )
+    {
+        SendLine( client, "ERROR cannot parse sensor-roi" );
+        return;
+    }
+    int xBinning = 1, yBinning = 1;
+    if( !ParseCount( Field( fields, "bin-x", "1" ), &xBinning ) )
+    {
+        SendLine( client, "ERROR cannot parse bin-x" );
+        return;
+    }
+    if( !ParseCount( Field( fields, "bin-y", "1" ), &yBinning ) )
+    {
+        SendLine( client, "ERROR cannot parse bin-y" );
+        return;
+    }
+    roi.x_binning = xBinning;
+    roi.y_binning = yBinning;
+    double exposureMs = 0;
+    bool setExposure = fields.count( "exposure-ms" ) > 0;
+    if( setExposure && !ParseMilliseconds( Field( fields, "exposure-ms", "" ), &exposureMs ) )
+    {
+        SendLine( client, "ERROR cannot parse exposure-ms" );
+        return;
+    }
+
+    // only what the job changes goes to the camera
+    daemon.parameters->SetRoi( roi );
+    if( setExposure )
+        daemon.parameters->SetFloatingPoint( PicamParameter_ExposureTime, exposureMs );
+    if( !daemon.parameters->Commit( daemon.verboseOutput ) )
+    {
+        SendLine( client, "ERROR commit failed, see the daemon's output" );
+        return;
+    }
+
+    FrameGeometry geometry;
+    if( !GetFrameGeometry( daemon.camera, &geometry ) )
+    {
+        SendLine( client, "ERROR cannot read the frame geometry" );
+        return;
+    }
+    int firstRow = 0, lastRow = 0, firstCol = 0, lastCol = 0;
+    if( !ParseFrameRange( Field( fields, "roi-rows", "all" ).c_str(), geometry.y, geometry.yBinning, geometry.rows, &firstRow, &lastRow ) )
+    {
+        SendLine( client, "ERROR cannot parse roi-rows" );
+        return;
+    }
+    if( !ParseFrameRange( Field( fields, "roi-cols", "all" ).c_str(), geometry.x, geometry.xBinning, geometry.cols, &firstCol, &lastCol ) )
+    {
+        SendLine( client, "ERROR cannot parse roi-cols" );
+        return;
+    }
+
+    RecordHeader header = MakeRecordHeader( lastRow - firstRow, lastCol - firstCol, lastCol - firstCol, 0, RecordFrames );
+    header.sensorX = geometry.x;
+    header.sensorY = geometry.y;
+    header.xBinning = geometry.xBinning;
+    header.yBinning = geometry.yBinning;
+    header.roiFirstRow = firstRow;
+    header.roiFirstCol = firstCol;
+    piflt exposure = 0, adcSpeed = 0;
+    Picam_GetParameterFloatingPointValue( daemon.camera, PicamParameter_ExposureTime, &exposure );
+    Picam_GetParameterFloatingPointValue( daemon.camera, PicamParameter_AdcSpeed, &adcSpeed );
+    header.exposureMs = exposure;
+    header.adcMHz = adcSpeed;
+
+    RecordWriter file;
+    std::string record = Field( fields, "record", "" );
+    if( !record.empty() && !file.Open( record, header ) )
+    {
+        SendLine( client, "ERROR cannot open " + record );
+        return;
+    }
+
+    FrameStream stream( daemon.camera, *daemon.parameters, daemon.circularReadouts, daemon.verboseOutput );
+    if( !stream.Start() )
+    {
+        SendLine( client, "ERROR cannot start the acquisition" );
+        return;
+    }
+
+    bool streaming = Field( fields, "stream", "1" ) != "0";
+    std::stringstream reply;
+    reply << "OK rows=" << header.rows << " cols=" << header.cols << " stream=" << ( streaming ? 1 : 0 );
+    bool connected = SendLine( client, reply.str() );
+    RecordWriter out;
+    if( streaming && connected )
+        connected = out.Open( client, "client", header );
+
+    long long written = 0;
+    FrameHandle frame;
+    while( connected && written < shots && stream.Pop( frame ) )
+    {
+        const uint16_t* pixels = (const uint16_t*)frame.Data() + (size_t)firstRow * geometry.cols + firstCol;
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if( streaming )
+            connected = out.Write( written, now, pixels, geometry.cols, NULL, NULL, 0 ) && out.Flush();
+        if( file.IsOpen() )
+            file.Write( written, now, pixels, geometry.cols, NULL, NULL, 0 );
+        frame.Release();
+        written++;
+    }
+    frame.Release();
+    stream.Stop();
+    if( daemon.verboseOutput )
+        stream.PrintStatistics();
+    file.Close();
+    out.Close();
+    daemon.jobs++;
+
+    if( !connected )
+    {
+        std::cout << "Client went away after " << written << " shots\n";
+        return;
+    }
+    if( streaming )
+    {
+        RecordEntry end;
+        memset( &end, 0, sizeof(end) );
+        end.number = RECORD_STREAM_END;
+        SendAll( client, &end, sizeof(end) );
+    }
+    std::stringstream done;
+    done << "DONE shots=" << written << " temperature=" << Temperature( daemon.camera );
+    SendLine( client, done.str() );
+}
+
+// Serve requests from one client until it hangs up; false to shut down.
+static bool Serve(Daemon& daemon, int client)
+{
+    std::string line;
+    while( !stopRequested && ReceiveLine( client, &line ) )
+    {
+        std::stringstream words( line );
+        std::string command, reason;
+        std::map<std::string, std::string> fields;
+        words >> command;
+        if( daemon.verboseOutput )
+            std::cout << "Request: " << line << "\n";
+
+        if( !ParseFields( words, &fields, &reason ) )
+            SendLine( client, "ERROR " + reason );
+        else if( command == "status" )
+            Status( daemon, client );
+        else if( command == "acquire" )
+            Acquire( daemon, client, fields );
+        else if( command == "shutdown" )
+        {
+            SendLine( client, "OK" );
+            return false;
+        }
+        else
+            SendLine( client, "ERROR unknown request " + command );
+    }
+    return true;
+}
+
+int main(int ac, char* av[])
+{
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "produce help message")
+        ("verbose", "explain each step")
+        ("socket", po::value<std::string>()->default_value(DEFAULT_SOCKET), "Unix domain socket to take jobs on")
+        ("temperature", po::value<double>()->default_value(-120), "sensor temperature set point, degrees C")
+        ("adc-mhz", po::value<double>()->default_value(4), "ADC speed")
+        ("circular-readouts", po::value<int>()->default_value(64), "readouts in the PICam circular buffer")
+    ;
+    po::variables_map vm;
+    po::store( po::parse_command_line( ac, av, desc ), vm );
+    po::notify( vm );
+    if( vm.count( "help" ) )
+    {
+        std::cout << desc << "\n";
+        return 1;
+    }
+
+    Daemon daemon;
+    daemon.verboseOutput = vm.count( "verbose" );
+    daemon.circularReadouts = vm["circular-readouts"].as<int>();
+    daemon.jobs = 0;
+    daemon.started = std::chrono::steady_clock::now();
+
+    Picam_InitializeLibrary();
+    if( Picam_OpenFirstCamera( &daemon.camera ) != PicamError_None )
+    {
+        std::cout << "Cannot open a camera\n";
+        Picam_UninitializeLibrary();
+        return 1;
+    }
+
+    // start cooling straight away; it is the slow part
+    CameraParameters parameters( daemon.camera );
+    daemon.parameters = &parameters;
+    parameters.SetFloatingPoint( PicamParameter_AdcSpeed, vm["adc-mhz"].as<double>() );
+    parameters.SetFloatingPoint( PicamParameter_SensorTemperatureSetPoint, vm["temperature"].as<double>() );
+    parameters.SetRoi( FullSensorRoi() );
+    parameters.Commit( daemon.verboseOutput );
+
+    std::string path = vm["socket"].as<std::string>();
+    int server = ListenLocal( path );
+    if( server < 0 )
+    {
+        Picam_CloseCamera( daemon.camera );
+        Picam_UninitializeLibrary();
+        return 1;
+    }
+
+    // let a signal interrupt accept() rather than restart it
+    struct sigaction action;
+    memset( &action, 0, sizeof(action) );
+    action.sa_handler = OnSignal;
+    sigaction( SIGINT, &action, NULL );
+    sigaction( SIGTERM, &action, NULL );
+    signal( SIGPIPE, SIG_IGN );
+
+    std::cout << "pylond listening on " << path << ", sensor at " << Temperature( daemon.camera )
+              << " C cooling to " << vm["temperature"].as<double>() << " C" << std::endl;
+    bool running = true;
+    while( running && !stopRequested )
+    {
+        int client = accept( server, NULL, NULL );
+        if( client < 0 )
+            continue;
+        running = Serve( daemon, client );
+        close( client );
+    }
+
+    std::cout << "pylond shutting down after " << daemon.jobs << " jobs" << std::endl;
+    parameters.PrintStatistics();
+    close( server );
+    unlink( path.c_str() );
+    Picam_CloseCamera( daemon.camera );
+    Picam_UninitializeLibrary();
+    return 0;
+}
@@ -0,0 +1,110 @@
+// Send one request to the acquisition daemon and print the reply.
+//
+//     pylonjob [--socket path] [--output out.rec] request [key=value ...]
+//
+// e.g. pylonjob -o run.rec acquire shots=1000 roi-rows=195:205
+// Shots streamed back by an acquire request are written to -o as a
+// recording (see RecordFile.h) or just counted.  -s and -o are short for
+// --socket and --output.
+
+#include "RecordFile.h"
+#include "LocalSocket.h"
+
+#include <iostream>
+#include <vector>
+#include <unistd.h>
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+int main(int ac, char* av[])
+{
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "produce help message")
+        ("socket,s", po::value<std::string>()->default_value(DEFAULT_SOCKET), "Unix domain socket the daemon listens on")
+        ("output,o", po::value<std::string>()->default_value(""), "write the shots of an acquire request to this recording")
+        ("request", po::value<std::vector<std::string> >(), "request and its key=value fields, e.g. acquire shots=10")
+    ;
+    po::positional_options_description positional;
+    positional.add( "request", -1 );
+    po::variables_map vm;
+    try
+    {
+        po::store( po::command_line_parser( ac, av ).options( desc ).positional( positional ).run(), vm );
+        po::notify( vm );
+    }
+    catch( const po::error& error )
+    {
+        std::cout << error.what() << "\n" << desc << "\n";
+        return 1;
+    }
+    if( vm.count( "help" ) || !vm.count( "request" ) )
+    {
+        std::cout << "usage: " << av[0] << " [options] request [key=value ...]\n" << desc << "\n";
+        return 1;
+    }
+
+    std::string path = vm["socket"].as<std::string>();
+    std::string output = vm["output"].as<std::string>();
+    const std::vector<std::string>& words = vm["request"].as<std::vector<std::string> >();
+    std::string request = words[0];
+    for( size_t i = 1; i < words.size(); i++ )
+        request += " " + words[i];
+
+    int fd = ConnectLocal( path );
+    if( fd < 0 )
+        return 1;
+    std::string reply;
+    if( !SendLine( fd, request ) || !ReceiveLine( fd, &reply ) )
+    {
+        std::cout << "No reply from " << path << "\n";
+        close( fd );
+        return 1;
+    }
+    std::cout << reply << "\n";
+
+    // an acquire reply is followed by the streamed recording, if asked
+    // for, and then the DONE line
+    bool acquiring = reply.compare( 0, 3, "OK " ) == 0 && reply.find( " stream=" ) != std::string::npos;
+    bool ok = true;
+    if( acquiring && reply.find( " stream=1" ) != std::string::npos )
+    {
+        FILE* file = output.empty() ? NULL : fopen( output.c_str(), "wb" );
+        if( !output.empty() && !file )
+            std::cout << "Cannot open " << output << ", counting shots only\n";
+
+        RecordHeader header;
+        ok = ReceiveAll( fd, &header, sizeof(header) ) && header.recordBytes >= sizeof(RecordEntry);
+        if( ok && file )
+            fwrite( &header, sizeof(header), 1, file );
+        std::vector<char> payload( ok ? header.recordBytes - sizeof(RecordEntry) : 0 );
+        long long shots = 0;
+        while( ok )
+        {
+            RecordEntry entry;
+            ok = ReceiveAll( fd, &entry, sizeof(entry) );
+            if( !ok || entry.number == RECORD_STREAM_END )
+                break;
+            ok = payload.empty() || ReceiveAll( fd, &payload[0], payload.size() );
+            if( ok && file )
+            {
+                fwrite( &entry, sizeof(entry), 1, file );
+                fwrite( &payload[0], 1, payload.size(), file );
+            }
+            shots += ok;
+        }
+        if( file )
+            fclose( file );
+        std::cout << shots << " shots received" << ( file ? " into " + output : std::string() ) << "\n";
+    }
+    if( acquiring )
+    {
+        if( ok && ReceiveLine( fd, &reply ) )
+            std::cout << reply << "\n";
+        else
+            std::cout << "Stream from " << path << " ended early\n";
+    }
+    close( fd );
+    return reply.compare( 0, 5, "ERROR" ) == 0;
+}
@@ -0,0 +1,41 @@
+#include "ReadoutBatch.h"
+
+#include <stdio.h>
+
+ReadoutBatch::ReadoutBatch(const FrameGeometry& geometry)
+    : geometry(geometry),
+      metadata(NULL),
+      initial(NULL),
+      count(0),
+      calls(0),
+      frames(0)
+{
+}
+
+bool ReadoutBatch::Acquire(PicamHandle camera, int readouts, piint timeout)
+{
+    PicamAvailableData data;
+    PicamAcquisitionErrorsMask errors = PicamAcquisitionErrorsMask_None;
+    data.initial_readout = NULL;
+    data.readout_count = 0;
+    PicamError error = Picam_Acquire( camera, readouts, timeout, &data, &errors );
+
+    initial = (const pibyte*)data.initial_readout;
+    count = error == PicamError_None || data.initial_readout ? (int)data.readout_count : 0;
+    calls++;
+    frames += count;
+    if( metadata )
+    {
+        // each Picam_Acquire is an acquisition of its own
+        metadata->NewAcquisition();
+        metadata->AddErrors( errors );
+        for( int n = 0; n < count; n++ )
+            metadata->Add( initial + (size_t)n * geometry.readoutStride );
+    }
+    if( error != PicamError_None || errors != PicamAcquisitionErrorsMask_None )
+    {
+        printf( "Error: Camera only collected %d of %d frames\n", count, readouts );
+        return false;
+    }
+    return count == readouts;
+}
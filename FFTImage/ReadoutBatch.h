@@ -0,0 +1,46 @@
+// Several readouts from one blocking Picam_Acquire.
+//
+// Picam_Acquire(camera, N, ...) returns N readouts back to back, each
+// ReadoutStride bytes from the last, in memory PICam owns until the next
+// acquisition.  ReadoutBatch hands out each one in place, so acquiring a
+// batch costs one call and no copies, and the per-call overhead is spread
+// over N frames.
+
+#ifndef READOUTBATCH_H
+#define READOUTBATCH_H
+
+#include <stddef.h>
+#include "picam.h"
+#include "SensorGeometry.h"
+#include "ReadoutMetadata.h"
+
+class ReadoutBatch
+{
+public:
+    explicit ReadoutBatch(const FrameGeometry& geometry);
+
+    // every readout and error passes through metadata, if set
+    void SetMetadata(ReadoutMetadata* metadata) { this->metadata = metadata; }
+
+    // Acquire up to count readouts; false (with Count() telling how many
+    // arrived) on error or time out.  Invalidates the previous batch.
+    bool Acquire(PicamHandle camera, int count, piint timeout);
+
+    int Count() const { return count; }
+
+    // geometry.rows x geometry.cols pixels, valid until the next Acquire
+    const pi16u* Frame(int n) const { return (const pi16u*)( initial + (size_t)n * geometry.readoutStride ); }
+
+    long long Calls() const { return calls; }
+    long long Frames() const { return frames; }
+
+private:
+    FrameGeometry geometry;
+    ReadoutMetadata* metadata;
+    const pibyte* initial;
+    int count;
+    long long calls;
+    long long frames;
+};
+
+#endif
@@ -0,0 +1,181 @@
+#include "ReadoutMetadata.h"
+
+#include <cstring>
+#include <iostream>
+
+PicamError ReadoutMetadata::Enable(CameraParameters& parameters)
+{
+    PicamError error = parameters.SetInteger( PicamParameter_TimeStamps, PicamTimeStampsMask_ExposureStarted );
+    PicamError tracking = parameters.SetInteger( PicamParameter_TrackFrames, true );
+    return error != PicamError_None ? error : tracking;
+}
+
+ReadoutMetadata::ReadoutMetadata(double reportSeconds)
+    : hasTimeStamps(false),
+      hasTracking(false),
+      timeStampOffset(0),
+      timeStampBits(0),
+      ticksPerSecond(0),
+      trackingOffset(0),
+      trackingBits(0),
+      first(true),
+      lastStamp(0),
+      lastTracking(0),
+      readouts(0),
+      dropped(0),
+      gaps(0),
+      overruns(0),
+      connectionLost(0),
+      intervals(0),
+      intervalSum(0),
+      intervalMin(0),
+      intervalMax(0),
+      reportSeconds(reportSeconds),
+      lastReport(std::chrono::steady_clock::now()),
+      reportReadouts(0),
+      reportIntervals(0),
+      reportIntervalSum(0)
+{
+}
+
+bool ReadoutMetadata::Configure(PicamHandle camera, const FrameGeometry& geometry)
+{
+    piint stamps = PicamTimeStampsMask_None, stampBits = 0, track = false, trackBits = 0;
+    pi64s resolution = 0;
+    Picam_GetParameterIntegerValue( camera, PicamParameter_TimeStamps, &stamps );
+    Picam_GetParameterLargeIntegerValue( camera, PicamParameter_TimeStampResolution, &resolution );
+    Picam_GetParameterIntegerValue( camera, PicamParameter_TimeStampBitDepth, &stampBits );
+    Picam_GetParameterIntegerValue( camera, PicamParameter_TrackFrames, &track );
+    Picam_GetParameterIntegerValue( camera, PicamParameter_FrameTrackingBitDepth, &trackBits );
+
+    // started, ended, then the tracking number, each only if enabled
+    int offset = geometry.frameBytes;
+    hasTimeStamps = stamps != PicamTimeStampsMask_None && stampBits > 0 && resolution > 0;
+    if( hasTimeStamps )
+    {
+        timeStampOffset = offset;
+        timeStampBits = stampBits;
+        ticksPerSecond = (double)resolution;
+        if( stamps & PicamTimeStampsMask_ExposureStarted )
+            offset += stampBits / 8;
+        if( stamps & PicamTimeStampsMask_ExposureEnded )
+            offset += stampBits / 8;
+    }
+    hasTracking = track && trackBits > 0;
+    if( hasTracking )
+    {
+        trackingOffset = offset;
+        trackingBits = trackBits;
+        offset += trackBits / 8;
+    }
+
+    if( offset > geometry.readoutStride )
+    {
+        std::cout << "Readout metadata (" << offset - geometry.frameBytes << " bytes) does not fit the "
+                  << geometry.readoutStride << " byte readout stride, ignoring it\n";
+        hasTimeStamps = hasTracking = false;
+    }
+    return hasTimeStamps || hasTracking;
+}
+
+void ReadoutMetadata::NewAcquisition()
+{
+    first = true;
+}
+
+// Fields are little-endian counts of bits / 8 bytes.
+unsigned long long ReadoutMetadata::Field(const pibyte* readout, int offset, int bits) const
+{
+    unsigned long long value = 0;
+    memcpy( &value, readout + offset, bits < 64 ? bits / 8 : sizeof(value) );
+    return value;
+}
+
+void ReadoutMetadata::Add(const pibyte* readout)
+{
+    readouts++;
+
+    // differences wrap at the field width, so a narrow counter rolling
+    // over is not taken for a jump
+    if( hasTracking )
+    {
+        unsigned long long tracking = Field( readout, trackingOffset, trackingBits );
+        unsigned long long mask = trackingBits < 64 ? ( 1ULL << trackingBits ) - 1 : ~0ULL;
+        unsigned long long step = ( tracking - lastTracking ) & mask;
+        if( !first && step > 1 )
+        {
+            dropped += (long long)( step - 1 );
+            gaps++;
+        }
+        lastTracking = tracking;
+    }
+    if( hasTimeStamps )
+    {
+        unsigned long long stamp = Field( readout, timeStampOffset, timeStampBits );
+        unsigned long long mask = timeStampBits < 64 ? ( 1ULL << timeStampBits ) - 1 : ~0ULL;
+        if( !first )
+        {
+            double interval = ( ( stamp - lastStamp ) & mask ) / ticksPerSecond;
+            if( intervals == 0 || interval < intervalMin )
+                intervalMin = interval;
+            if( intervals == 0 || interval > intervalMax )
+                intervalMax = interval;
+            intervalSum += interval;
+            intervals++;
+        }
+        lastStamp = stamp;
+    }
+    first = false;
+
+    if( reportSeconds > 0
+        && std::chrono::steady_clock::now() - lastReport >= std::chrono::duration<double>( reportSeconds ) )
+        Report();
+}
+
+void ReadoutMetadata::AddErrors(PicamAcquisitionErrorsMask errors)
+{
+    if( errors & PicamAcquisitionErrorsMask_DataLost )
+        overruns++;
+    if( errors & PicamAcquisitionErrorsMask_ConnectionLost )
+        connectionLost++;
+}
+
+// Totals so far, and the frame rate the camera achieved since the last
+// report.
+void ReadoutMetadata::Report()
+{
+    std::cout << "Frames: " << readouts << " read out";
+    if( hasTracking )
+        std::cout << ", " << dropped << " dropped";
+    std::cout << ", " << overruns << " overruns";
+    long long windowIntervals = intervals - reportIntervals;
+    double windowSeconds = intervalSum - reportIntervalSum;
+    if( windowIntervals > 0 && windowSeconds > 0 )
+        std::cout << ", " << windowIntervals / windowSeconds << " fps";
+    else
+        std::cout << ", " << readouts - reportReadouts << " new";
+    std::cout << std::endl;
+
+    lastReport = std::chrono::steady_clock::now();
+    reportReadouts = readouts;
+    reportIntervals = intervals;
+    reportIntervalSum = intervalSum;
+}
+
+void ReadoutMetadata::PrintStatistics() const
+{
+    std::cout << "Frames: " << readouts << " read out";
+    if( hasTracking )
+        std::cout << ", " << dropped << " dropped in " << gaps << " gap(s)";
+    else
+        std::cout << ", no frame tracking";
+    std::cout << ", " << overruns << " overrun(s)";
+    if( connectionLost )
+        std::cout << ", connection lost " << connectionLost << " time(s)";
+    if( intervals > 0 )
+        std::cout << "; interval " << intervalMin * 1000 << " / " << intervalSum / intervals * 1000
+                  << " / " << intervalMax * 1000 << " ms min / mean / max";
+    else if( !hasTimeStamps )
+        std::cout << ", no time stamps";
+    std::cout << std::endl;
+}
@@ -0,0 +1,84 @@
+// Time stamps and frame tracking read back from every readout.
+//
+// With PicamParameter_TimeStamps and PicamParameter_TrackFrames enabled
+// the camera appends metadata to each readout, after the pixels: the
+// exposure-started and exposure-ended stamps (whichever are enabled) in
+// ticks of TimeStampResolution per second, then the frame-tracking
+// number.  ReadoutMetadata finds those fields at the layout the committed
+// parameters describe and keeps the statistics that say whether the host
+// is keeping up at full rate: frames the camera read out that never
+// reached us (gaps in the tracking number), overruns the camera reported
+// in the acquisition errors, and the interval between exposures measured
+// by the camera's own clock rather than by when we got round to a frame.
+// A one-line summary is printed every reportSeconds while running.
+
+#ifndef READOUTMETADATA_H
+#define READOUTMETADATA_H
+
+#include <chrono>
+#include "picam.h"
+#include "SensorGeometry.h"
+#include "CameraParameters.h"
+
+class ReadoutMetadata
+{
+public:
+    // Ask for exposure-started time stamps and frame tracking; takes
+    // effect at the next commit.  Returns the first error.
+    static PicamError Enable(CameraParameters& parameters);
+
+    // report every reportSeconds while readouts arrive, 0 = only at the end
+    explicit ReadoutMetadata(double reportSeconds);
+
+    // Find the metadata in the committed readout layout; false if the
+    // camera appends none (readouts and errors are still counted).
+    bool Configure(PicamHandle camera, const FrameGeometry& geometry);
+
+    // Each acquisition numbers and stamps its readouts from the start, so
+    // nothing is compared across the boundary.
+    void NewAcquisition();
+
+    // One readout, in the order the camera delivered them.
+    void Add(const pibyte* readout);
+    // Errors from Picam_Acquire or Picam_WaitForAcquisitionUpdate.
+    void AddErrors(PicamAcquisitionErrorsMask errors);
+
+    long long Readouts() const { return readouts; }
+    long long Dropped() const { return dropped; }
+    long long Overruns() const { return overruns; }
+    void PrintStatistics() const;
+
+private:
+    unsigned long long Field(const pibyte* readout, int offset, int bits) const;
+    void Report();
+
+    bool hasTimeStamps;
+    bool hasTracking;
+    int timeStampOffset;            // bytes from the start of the readout
+    int timeStampBits;
+    double ticksPerSecond;
+    int trackingOffset;
+    int trackingBits;
+
+    bool first;                     // no previous readout in this acquisition
+    unsigned long long lastStamp;
+    unsigned long long lastTracking;
+
+    long long readouts;
+    long long dropped;
+    long long gaps;                 // runs of dropped frames
+    long long overruns;             // updates reporting lost data
+    long long connectionLost;
+    long long intervals;
+    double intervalSum;             // seconds between exposures
+    double intervalMin;
+    double intervalMax;
+
+    double reportSeconds;
+    std::chrono::steady_clock::time_point lastReport;
+    long long reportReadouts;       // at the last report
+    long long reportIntervals;
+    double reportIntervalSum;
+};
+
+#endif
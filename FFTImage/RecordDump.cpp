@@ -0,0 +1,77 @@
+// Print the header and shot list of an FFTimage recording.
+//
+//     recdump test.rec [first [count]]
+
+#include "RecordFile.h"
+#include "RowConvert.h"
+
+#include <cstdlib>
+#include <iostream>
+
+// zero or more, and nothing after it
+static bool ParseIndex(const char* text, long long* value)
+{
+    char* end = NULL;
+    long long index = strtoll( text, &end, 10 );
+    if( end == text || *end != '\0' || index < 0 )
+        return false;
+    *value = index;
+    return true;
+}
+
+int main(int ac, char* av[])
+{
+    if( ac < 2 )
+    {
+        std::cout << "usage: " << av[0] << " recording [first [count]]\n";
+        return 1;
+    }
+
+    long long first = 0, count = 0;
+    if( ( ac > 2 && !ParseIndex( av[2], &first ) ) || ( ac > 3 && !ParseIndex( av[3], &count ) ) )
+    {
+        std::cout << "first and count must be whole numbers of zero or more\n";
+        return 1;
+    }
+
+    RecordReader reader;
+    if( !reader.Open( av[1] ) )
+        return 1;
+
+    const RecordHeader& h = reader.Header();
+    std::cout << av[1] << ": " << reader.Count() << " shots of " << h.recordBytes << " bytes\n"
+              << "    ROI " << h.rows << "x" << h.cols << " at row " << h.roiFirstRow << ", column " << h.roiFirstCol
+              << " of the frame read from sensor (" << h.sensorX << "," << h.sensorY << ")"
+              << ", binning " << h.xBinning << "x" << h.yBinning;
+    if( h.binnedRows > 0 )
+        std::cout << ", " << h.binnedRows << " rows averaged into each";
+    if( h.window != WindowNone )
+        std::cout << ", " << RowConverter::WindowName( h.window ) << " window";
+    std::cout << "\n"
+              << "    " << ( h.contents & RecordStatistics ? "statistics of " : "" )
+              << ( h.contents & RecordFrames ? ( h.contents & RecordFloatFrames ? "float frames " : "frames " ) : "" )
+              << ( h.contents & RecordSpectra ? "spectra " : "" )
+              << ( h.contents & RecordCoherent ? "coherent " : "" )
+              << "(" << h.spectrumCols << " of " << h.paddedCols << " bins per row)\n"
+              << "    exposure " << h.exposureMs << " ms, ADC " << h.adcMHz << " MHz\n";
+
+    if( ac <= 3 )
+        count = reader.Count();
+    for( long long n = first; n < reader.Count() && n - first < count; n++ )
+    {
+        const RecordEntry& e = reader.Entry( n );
+        std::cout << "    shot " << e.number << " at " << e.timestamp / 1e6 << " ms";
+        if( n > 0 )
+            std::cout << " (+" << ( e.timestamp - reader.Entry( n - 1 ).timestamp ) / 1e6 << " ms)";
+        if( reader.Frame( n ) )
+            std::cout << ", first pixel " << reader.Frame( n )[0];
+        if( reader.FloatFrame( n ) )
+            std::cout << ", first pixel " << reader.FloatFrame( n )[0];
+        if( reader.Real( n ) )
+            std::cout << ", DC bin " << reader.Real( n )[0];
+        if( reader.Statistics( n ) )
+            std::cout << ", " << e.shots << " shots, first pixel mean " << reader.Statistics( n )[0];
+        std::cout << "\n";
+    }
+    return 0;
+}
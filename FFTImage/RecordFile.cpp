@@ -0,0 +1,378 @@
+#include "RecordFile.h"
+
+#include <cstring>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define WRITE_BUFFER_BYTES  (4 << 20)
+
+static_assert( sizeof(RecordHeader) == 128, "RecordHeader is part of the file format" );
+static_assert( sizeof(RecordEntry) == 32, "RecordEntry is part of the file format" );
+
+static size_t Aligned8(size_t bytes)
+{
+    return (bytes + 7) & ~(size_t)7;
+}
+
+static size_t PixelBytes(const RecordHeader& h)
+{
+    return h.contents & RecordFloatFrames ? sizeof(float) : sizeof(uint16_t);
+}
+
+static size_t FrameBytes(const RecordHeader& h)
+{
+    return h.contents & RecordFrames && !(h.contents & RecordStatistics) ? Aligned8( (size_t)h.rows * h.cols * PixelBytes( h ) ) : 0;
+}
+
+static size_t SpectrumPlaneBytes(const RecordHeader& h)
+{
+    return h.contents & RecordSpectra && !(h.contents & RecordStatistics) ? Aligned8( (size_t)h.rows * h.spectrumCols * sizeof(float) ) : 0;
+}
+
+RecordHeader MakeRecordHeader(int rows, int cols, int paddedCols, int spectrumCols, unsigned contents)
+{
+    RecordHeader h;
+    memset( &h, 0, sizeof(h) );
+    memcpy( h.magic, RECORD_MAGIC, sizeof(h.magic) );
+    h.version = RECORD_VERSION;
+    h.contents = contents;
+    h.rows = rows;
+    h.cols = cols;
+    h.paddedCols = paddedCols;
+    h.spectrumCols = spectrumCols;
+    h.xBinning = 1;
+    h.yBinning = 1;
+    return h;
+}
+
+size_t StatisticsBytes(const RecordHeader& h)
+{
+    if( !(h.contents & RecordStatistics) )
+        return 0;
+    size_t frame = (size_t)h.rows * h.cols * sizeof(double);
+    size_t spectrum = (size_t)h.rows * h.spectrumCols * sizeof(double);
+    return 2 * frame
+         + ( h.contents & RecordSpectra ? 2 * spectrum : 0 )
+         + ( h.contents & RecordCoherent ? 3 * spectrum : 0 );
+}
+
+RecordWriter::RecordWriter()
+    : file(NULL),
+      buffer(NULL),
+      records(0)
+{
+    memset( &header, 0, sizeof(header) );
+}
+
+RecordWriter::~RecordWriter()
+{
+    Close();
+}
+
+bool RecordWriter::Open(const std::string& path, const RecordHeader& h)
+{
+    Close();
+    FILE* opened = fopen( path.c_str(), "wb" );
+    if( !opened )
+    {
+        std::cout << "Cannot open recording " << path << "\n";
+        return false;
+    }
+    return Start( opened, path, h );
+}
+
+bool RecordWriter::Open(int fd, const std::string& name, const RecordHeader& h)
+{
+    Close();
+    int copy = dup( fd );
+    FILE* opened = copy >= 0 ? fdopen( copy, "wb" ) : NULL;
+    if( !opened )
+    {
+        std::cout << "Cannot write a recording to " << name << "\n";
+        if( copy >= 0 )
+            ::close( copy );
+        return false;
+    }
+    return Start( opened, name, h );
+}
+
+bool RecordWriter::Start(FILE* stream, const std::string& name, const RecordHeader& h)
+{
+    header = h;
+    header.headerBytes = sizeof(RecordHeader);
+    header.recordBytes = sizeof(RecordEntry) + FrameBytes( header ) + 2 * SpectrumPlaneBytes( header )
+                       + StatisticsBytes( header );
+    opened = std::chrono::steady_clock::now();
+    header.startTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::system_clock::now().time_since_epoch() ).count();
+
+    file = stream;
+    buffer = new char[WRITE_BUFFER_BYTES];
+    setvbuf( file, buffer, _IOFBF, WRITE_BUFFER_BYTES );
+
+    this->path = name;
+    records = 0;
+    if( fwrite( &header, sizeof(header), 1, file ) != 1 )
+    {
+        std::cout << "Cannot write recording header to " << path << "\n";
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool RecordWriter::Flush()
+{
+    if( !file )
+        return false;
+    if( fflush( file ) != 0 )
+    {
+        std::cout << "Recording to " << path << " failed, closing it\n";
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void RecordWriter::Close()
+{
+    if( file )
+        fclose( file );
+    file = NULL;
+    delete[] buffer;
+    buffer = NULL;
+}
+
+bool RecordWriter::Write(long long number, std::chrono::steady_clock::time_point acquired,
+                         const uint16_t* frame, size_t frameStride,
+                         const float* real, const float* imag, size_t spectrumStride)
+{
+    return WriteShot( number, acquired, frame, sizeof(uint16_t), frameStride, real, imag, spectrumStride );
+}
+
+bool RecordWriter::Write(long long number, std::chrono::steady_clock::time_point acquired,
+                         const float* frame, size_t frameStride,
+                         const float* real, const float* imag, size_t spectrumStride)
+{
+    return WriteShot( number, acquired, frame, sizeof(float), frameStride, real, imag, spectrumStride );
+}
+
+bool RecordWriter::WriteShot(long long number, std::chrono::steady_clock::time_point acquired,
+                             const void* frame, size_t pixelBytes, size_t frameStride,
+                             const float* real, const float* imag, size_t spectrumStride)
+{
+    if( !file )
+        return false;
+    if( header.contents & RecordFrames && pixelBytes != PixelBytes( header ) )
+    {
+        std::cout << "Frame pixels do not match the recording " << path << ", not writing\n";
+        return false;
+    }
+
+    static const char padding[8] = { 0 };
+    bool ok = true;
+
+    RecordEntry entry;
+    memset( &entry, 0, sizeof(entry) );
+    entry.number = number;
+    entry.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>( acquired - opened ).count();
+    entry.contents = header.contents;
+    entry.shots = 1;
+    ok &= fwrite( &entry, sizeof(entry), 1, file ) == 1;
+
+    // rows are written one at a time since the source ROI is not
+    // necessarily contiguous
+    if( header.contents & RecordFrames )
+    {
+        const char* pixels = (const char*)frame;
+        for( int r = 0; r < header.rows; r++ )
+            ok &= fwrite( pixels + r * frameStride * pixelBytes, pixelBytes, header.cols, file ) == (size_t)header.cols;
+        size_t bytes = (size_t)header.rows * header.cols * pixelBytes;
+        ok &= fwrite( padding, 1, FrameBytes( header ) - bytes, file ) == FrameBytes( header ) - bytes;
+    }
+    if( header.contents & RecordSpectra )
+    {
+        const float* planes[] = { real, imag };
+        size_t bytes = (size_t)header.rows * header.spectrumCols * sizeof(float);
+        for( int p = 0; p < 2; p++ )
+        {
+            for( int r = 0; r < header.rows; r++ )
+                ok &= fwrite( planes[p] + r * spectrumStride, sizeof(float), header.spectrumCols, file )
+                      == (size_t)header.spectrumCols;
+            ok &= fwrite( padding, 1, SpectrumPlaneBytes( header ) - bytes, file ) == SpectrumPlaneBytes( header ) - bytes;
+        }
+    }
+
+    if( !ok )
+    {
+        std::cout << "Recording to " << path << " failed, closing it\n";
+        Close();
+        return false;
+    }
+    records++;
+    return true;
+}
+
+bool RecordWriter::WriteStatistics(long long number, std::chrono::steady_clock::time_point acquired,
+                                   long long shots, const double* planes)
+{
+    if( !file )
+        return false;
+
+    RecordEntry entry;
+    memset( &entry, 0, sizeof(entry) );
+    entry.number = number;
+    entry.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>( acquired - opened ).count();
+    entry.contents = header.contents;
+    entry.shots = (uint32_t)shots;
+    size_t bytes = StatisticsBytes( header );
+    if( fwrite( &entry, sizeof(entry), 1, file ) != 1 || fwrite( planes, 1, bytes, file ) != bytes )
+    {
+        std::cout << "Recording to " << path << " failed, closing it\n";
+        Close();
+        return false;
+    }
+    records++;
+    return true;
+}
+
+void RecordWriter::PrintStatistics() const
+{
+    std::cout << "Recording: " << records << " shots of " << header.recordBytes << " bytes to " << path << std::endl;
+}
+
+RecordReader::RecordReader()
+    : map(NULL),
+      mapBytes(0),
+      header(NULL),
+      count(0)
+{
+}
+
+RecordReader::~RecordReader()
+{
+    Close();
+}
+
+bool RecordReader::Open(const std::string& path)
+{
+    Close();
+
+    int fd = open( path.c_str(), O_RDONLY );
+    if( fd < 0 )
+    {
+        std::cout << "Cannot open recording " << path << "\n";
+        return false;
+    }
+    struct stat st;
+    if( fstat( fd, &st ) != 0 || (size_t)st.st_size < sizeof(RecordHeader) )
+    {
+        std::cout << path << " is too short to be a recording\n";
+        ::close( fd );
+        return false;
+    }
+
+    void* memory = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    ::close( fd );
+    if( memory == MAP_FAILED )
+    {
+        std::cout << "Cannot map recording " << path << "\n";
+        return false;
+    }
+    map = (const unsigned char*)memory;
+    mapBytes = st.st_size;
+    header = (const RecordHeader*)map;
+
+    // the file is in the writer's byte order; the version reads swapped
+    // when that is not ours
+    if( memcmp( header->magic, RECORD_MAGIC, sizeof(header->magic) ) == 0
+        && header->version == __builtin_bswap32( RECORD_VERSION ) )
+    {
+        std::cout << path << " was written with the other byte order\n";
+        Close();
+        return false;
+    }
+    if( memcmp( header->magic, RECORD_MAGIC, sizeof(header->magic) ) != 0
+        || header->version != RECORD_VERSION || header->recordBytes == 0 )
+    {
+        std::cout << path << " is not a version " << RECORD_VERSION << " recording\n";
+        Close();
+        return false;
+    }
+
+    // everything the accessors read must lie within the header's record
+    // size, and the records within the file
+    size_t needed = sizeof(RecordEntry) + FrameBytes( *header ) + 2 * SpectrumPlaneBytes( *header )
+                  + StatisticsBytes( *header );
+    if( header->rows < 0 || header->cols < 0 || header->spectrumCols < 0
+        || header->headerBytes < sizeof(RecordHeader) || header->headerBytes > mapBytes
+        || header->recordBytes < needed )
+    {
+        std::cout << path << " has a corrupt header\n";
+        Close();
+        return false;
+    }
+
+    // a partial last record (the writer died mid-shot) is left out
+    count = (long long)( (mapBytes - header->headerBytes) / header->recordBytes );
+    return true;
+}
+
+void RecordReader::Close()
+{
+    if( map )
+        munmap( (void*)map, mapBytes );
+    map = NULL;
+    mapBytes = 0;
+    header = NULL;
+    count = 0;
+}
+
+const unsigned char* RecordReader::Record(long long n) const
+{
+    return map + header->headerBytes + (size_t)n * header->recordBytes;
+}
+
+const RecordEntry& RecordReader::Entry(long long n) const
+{
+    return *(const RecordEntry*)Record( n );
+}
+
+const uint16_t* RecordReader::Frame(long long n) const
+{
+    if( !(header->contents & RecordFrames) || header->contents & (RecordStatistics | RecordFloatFrames) )
+        return NULL;
+    return (const uint16_t*)( Record( n ) + sizeof(RecordEntry) );
+}
+
+const float* RecordReader::FloatFrame(long long n) const
+{
+    if( !(header->contents & RecordFrames) || !(header->contents & RecordFloatFrames)
+        || header->contents & RecordStatistics )
+        return NULL;
+    return (const float*)( Record( n ) + sizeof(RecordEntry) );
+}
+
+const float* RecordReader::Real(long long n) const
+{
+    if( !(header->contents & RecordSpectra) || header->contents & RecordStatistics )
+        return NULL;
+    return (const float*)( Record( n ) + sizeof(RecordEntry) + FrameBytes( *header ) );
+}
+
+const double* RecordReader::Statistics(long long n) const
+{
+    if( !(header->contents & RecordStatistics) )
+        return NULL;
+    return (const double*)( Record( n ) + sizeof(RecordEntry) );
+}
+
+const float* RecordReader::Imag(long long n) const
+{
+    if( !(header->contents & RecordSpectra) || header->contents & RecordStatistics )
+        return NULL;
+    return (const float*)( Record( n ) + sizeof(RecordEntry) + FrameBytes( *header ) + SpectrumPlaneBytes( *header ) );
+}
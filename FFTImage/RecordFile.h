@@ -0,0 +1,166 @@
+// Binary recording of FFTimage shots.
+//
+// A recording is a fixed 128-byte RecordHeader followed by one record per
+// shot.  Every record in a file has the same size (RecordHeader::
+// recordBytes): a 32-byte RecordEntry with the shot number and timestamp,
+// then the ROI frame as uint16 (float32 with RecordFloatFrames) and the
+// spectrum as two float32 planes (Re, then Im), each rows x spectrumCols.
+// Everything is in the writer's native byte order (little-endian on x86;
+// RecordReader rejects a file of the other order) and 8-byte aligned, so
+// record n starts at headerBytes + n * recordBytes and a reader can map
+// the file and index it directly (RecordReader, or numpy.memmap as shown
+// in the README).  The file is only ever
+// appended to: a run that dies part way leaves a valid file whose last,
+// partial record is ignored.
+//
+// A statistics file (RecordStatistics set) has the same header, but each
+// record combines a block of shots (RecordEntry::shots).  Its payload is
+// float64 planes, in this order: frame mean and variance (rows x cols);
+// with RecordSpectra, the mean and variance of |X|^2 (rows x
+// spectrumCols); and with RecordCoherent, the mean Re, mean Im and
+// complex variance E|X - mean|^2 of the spectrum.
+//
+// The writer buffers in user space and issues large writes, so keeping
+// up with the camera costs a memcpy per shot rather than a syscall.
+
+#ifndef RECORDFILE_H
+#define RECORDFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <chrono>
+
+#define RECORD_MAGIC    "PYLONREC"
+#define RECORD_VERSION  1
+
+enum RecordContents
+{
+    RecordFrames      = 1,      // ROI pixels, uint16
+    RecordSpectra     = 2,      // Re and Im planes, float32
+    RecordStatistics  = 4,      // records are block statistics, float64
+    RecordCoherent    = 8,      // statistics include the coherent average
+    RecordFloatFrames = 16      // frames are float32 band means (binnedRows > 0)
+};
+
+struct RecordHeader
+{
+    char magic[8];              // RECORD_MAGIC, not terminated
+    uint32_t version;
+    uint32_t headerBytes;       // offset of the first record
+    uint32_t recordBytes;       // size of every record
+    uint32_t contents;          // RecordContents flags
+    int32_t rows;               // ROI rows (frame and spectrum)
+    int32_t cols;               // ROI columns in the frame
+    int32_t paddedCols;         // transform length of each row
+    int32_t spectrumCols;       // bins kept per row
+    int32_t sensorX, sensorY;   // sensor pixel at the start of the read-out frame
+    int32_t xBinning, yBinning;
+    int32_t roiFirstRow;        // ROI position in the read-out frame
+    int32_t roiFirstCol;
+    double exposureMs;
+    double adcMHz;
+    int64_t startTime;          // wall clock when the file was opened, ns since 1970
+    int32_t binnedRows;         // ROI rows averaged into each row (--fvb), 0 = none
+    int32_t window;             // RowWindow applied to the rows before the transforms, 0 = none
+    uint8_t reserved[32];
+};
+
+struct RecordEntry
+{
+    int64_t number;             // shot number, in acquisition order
+    int64_t timestamp;          // ns after startTime the shot was acquired
+    uint32_t contents;          // what this record holds, RecordContents
+    uint32_t shots;             // shots combined into this record
+    uint32_t reserved[2];
+};
+
+// Fill in everything but the sizes, which Open() works out.
+RecordHeader MakeRecordHeader(int rows, int cols, int paddedCols, int spectrumCols, unsigned contents);
+
+// Size of the float64 planes in one statistics record.
+size_t StatisticsBytes(const RecordHeader& header);
+
+class RecordWriter
+{
+public:
+    RecordWriter();
+    ~RecordWriter();
+
+    bool Open(const std::string& path, const RecordHeader& header);
+    // Write to an open descriptor, such as a socket, instead; name is only
+    // used in messages.  The descriptor is duplicated, so the caller still
+    // has to close its own.
+    bool Open(int fd, const std::string& name, const RecordHeader& header);
+    void Close();
+    bool Flush();
+    bool IsOpen() const { return file != NULL; }
+
+    // One shot.  Strides are in elements; either pointer may be NULL if
+    // the header does not ask for it.
+    bool Write(long long number, std::chrono::steady_clock::time_point acquired,
+               const uint16_t* frame, size_t frameStride,
+               const float* real, const float* imag, size_t spectrumStride);
+    // the same with a float frame, for a RecordFloatFrames file
+    bool Write(long long number, std::chrono::steady_clock::time_point acquired,
+               const float* frame, size_t frameStride,
+               const float* real, const float* imag, size_t spectrumStride);
+
+    // One block of shots in a statistics file; planes holds
+    // StatisticsBytes() in the order described above.
+    bool WriteStatistics(long long number, std::chrono::steady_clock::time_point acquired,
+                         long long shots, const double* planes);
+
+    const RecordHeader& Header() const { return header; }
+    long long Records() const { return records; }
+    void PrintStatistics() const;
+
+private:
+    RecordWriter(const RecordWriter&);
+    RecordWriter& operator=(const RecordWriter&);
+
+    bool Start(FILE* opened, const std::string& name, const RecordHeader& h);
+    bool WriteShot(long long number, std::chrono::steady_clock::time_point acquired,
+                   const void* frame, size_t pixelBytes, size_t frameStride,
+                   const float* real, const float* imag, size_t spectrumStride);
+
+    FILE* file;
+    char* buffer;
+    RecordHeader header;
+    std::string path;
+    std::chrono::steady_clock::time_point opened;
+    long long records;
+};
+
+class RecordReader
+{
+public:
+    RecordReader();
+    ~RecordReader();
+
+    bool Open(const std::string& path);
+    void Close();
+
+    const RecordHeader& Header() const { return *header; }
+    long long Count() const { return count; }
+
+    const RecordEntry& Entry(long long n) const;
+    const uint16_t* Frame(long long n) const;       // rows x cols
+    const float* FloatFrame(long long n) const;     // rows x cols, RecordFloatFrames only
+    const float* Real(long long n) const;           // rows x spectrumCols
+    const float* Imag(long long n) const;
+    const double* Statistics(long long n) const;    // planes of a statistics record
+
+private:
+    RecordReader(const RecordReader&);
+    RecordReader& operator=(const RecordReader&);
+
+    const unsigned char* Record(long long n) const;
+
+    const unsigned char* map;
+    size_t mapBytes;
+    const RecordHeader* header;
+    long long count;
+};
+
+#endif
@@ -0,0 +1,139 @@
+// Bounded lock-free queue between the stages of the FFTimage pipeline.
+//
+// This is the array-based multi-producer/multi-consumer queue described by
+// Dmitry Vyukov: every cell carries a sequence number that tells producers
+// and consumers whether it is free or full for the lap they are on, so a
+// push or pop is a single compare-and-swap on the shared position and no
+// thread ever holds a lock another one has to wait for.  The capacity is
+// rounded up to a power of two.
+//
+// TryPush() and TryPop() never block; what to do when a queue is full or
+// empty is up to the pipeline.  Depth() is only approximate while other
+// threads push and pop, which is all the statistics need.
+
+#ifndef RINGQUEUE_H
+#define RINGQUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+template <typename T>
+class RingQueue
+{
+public:
+    explicit RingQueue(size_t capacity)
+        : enqueuePos(0),
+          dequeuePos(0),
+          maxDepth(0),
+          depthSum(0),
+          pushes(0)
+    {
+        size_t size = 2;
+        while( size < capacity )
+            size *= 2;
+        mask = size - 1;
+        cells.reset( new Cell[size] );
+        for( size_t i = 0; i < size; i++ )
+            cells[i].sequence.store( i, std::memory_order_relaxed );
+    }
+
+    bool TryPush(const T& item)
+    {
+        Cell* cell;
+        size_t pos = enqueuePos.load( std::memory_order_relaxed );
+        for( ;; )
+        {
+            cell = &cells[pos & mask];
+            size_t sequence = cell->sequence.load( std::memory_order_acquire );
+            intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if( diff == 0 )
+            {
+                if( enqueuePos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+                    break;
+            }
+            else if( diff < 0 )
+                return false;               // full
+            else
+                pos = enqueuePos.load( std::memory_order_relaxed );
+        }
+        cell->item = item;
+        cell->sequence.store( pos + 1, std::memory_order_release );
+
+        size_t tail = dequeuePos.load( std::memory_order_relaxed );
+        size_t depth = pos + 1 > tail ? pos + 1 - tail : 0;
+        size_t seen = maxDepth.load( std::memory_order_relaxed );
+        while( depth > seen && !maxDepth.compare_exchange_weak( seen, depth, std::memory_order_relaxed ) )
+            ;
+        depthSum.fetch_add( depth, std::memory_order_relaxed );
+        pushes.fetch_add( 1, std::memory_order_relaxed );
+        return true;
+    }
+
+    bool TryPop(T& item)
+    {
+        Cell* cell;
+        size_t pos = dequeuePos.load( std::memory_order_relaxed );
+        for( ;; )
+        {
+            cell = &cells[pos & mask];
+            size_t sequence = cell->sequence.load( std::memory_order_acquire );
+            intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+            if( diff == 0 )
+            {
+                if( dequeuePos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+                    break;
+            }
+            else if( diff < 0 )
+                return false;               // empty
+            else
+                pos = dequeuePos.load( std::memory_order_relaxed );
+        }
+        item = cell->item;
+        cell->sequence.store( pos + mask + 1, std::memory_order_release );
+        return true;
+    }
+
+    size_t Capacity() const { return mask + 1; }
+
+    size_t Depth() const
+    {
+        size_t tail = dequeuePos.load( std::memory_order_relaxed );
+        size_t head = enqueuePos.load( std::memory_order_relaxed );
+        return head > tail ? head - tail : 0;
+    }
+
+    // deepest the queue has been, and its average depth seen by pushes
+    size_t MaxDepth() const { return maxDepth.load( std::memory_order_relaxed ); }
+    double MeanDepth() const
+    {
+        long long n = pushes.load( std::memory_order_relaxed );
+        return n ? (double)depthSum.load( std::memory_order_relaxed ) / n : 0.0;
+    }
+    long long Pushes() const { return pushes.load( std::memory_order_relaxed ); }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T item;
+    };
+
+    RingQueue(const RingQueue&);
+    RingQueue& operator=(const RingQueue&);
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+
+    // producers and consumers each hammer their own position; keep them
+    // on separate cache lines
+    alignas(64) std::atomic<size_t> enqueuePos;
+    alignas(64) std::atomic<size_t> dequeuePos;
+
+    alignas(64) std::atomic<size_t> maxDepth;
+    std::atomic<unsigned long long> depthSum;
+    std::atomic<long long> pushes;
+};
+
+#endif
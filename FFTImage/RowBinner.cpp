@@ -0,0 +1,30 @@
+#include "RowBinner.h"
+
+RowBinner::RowBinner(int rows, int cols)
+    : rows(rows),
+      cols(cols),
+      sums(cols)
+{
+}
+
+void RowBinner::Bin(const uint16_t* frame, size_t stride, float* binned)
+{
+    // locals, so the stores to sum cannot be taken to change the bounds
+    const int n = cols;
+    const int count = rows;
+    uint32_t* sum = &sums[0];
+    for( int c = 0; c < n; c++ )
+        sum[c] = frame[c];
+    for( int r = 1; r < count; r++ )
+    {
+        const uint16_t* row = frame + r * stride;
+        for( int c = 0; c < n; c++ )
+            sum[c] += row[c];
+    }
+
+    // a float rounds the sum of 400 full-scale rows by at most a count,
+    // a few thousandths of a count in the mean
+    const float scale = 1.0f / count;
+    for( int c = 0; c < n; c++ )
+        binned[c] = sum[c] * scale;
+}
@@ -0,0 +1,39 @@
+// Full vertical binning in software for FFTimage.
+//
+// When only one spectrum per shot is wanted, the band of ROI rows is
+// combined into a single row before anything is transformed, tracked or
+// recorded, which cuts both by the number of rows and averages the shot
+// noise of the band.  The rows are summed into 32-bit totals, one row at
+// a time over contiguous columns so the compiler widens and adds eight or
+// more pixels per instruction, and the totals are then divided back down
+// to the mean.  The mean is kept as a float: rounding it to whole counts
+// would add a quantisation noise of 0.29 counts, which is most of what
+// averaging the band of a quiet sensor gains.  The converter, the row
+// transforms, the tracked bins and the recordings all take float rows.
+
+#ifndef ROWBINNER_H
+#define ROWBINNER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+class RowBinner
+{
+public:
+    RowBinner(int rows, int cols);
+
+    // Average the rows x cols band at frame (stride in pixels) into the
+    // cols pixels at binned.
+    void Bin(const uint16_t* frame, size_t stride, float* binned);
+
+    int Rows() const { return rows; }
+    int Cols() const { return cols; }
+
+private:
+    int rows;
+    int cols;
+    std::vector<uint32_t> sums;
+};
+
+#endif
@@ -0,0 +1,364 @@
+#include "RowConvert.h"
+#include "Calibration.h"
+
+#include <cmath>
+#include <algorithm>
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define ROWCONVERT_X86
+#include <immintrin.h>
+#endif
+
+typedef void (*ConvertFunction)(const unsigned short* src, int cols, const float* offset, const float* scale,
+                                float* dst, int paddedCols);
+typedef void (*ConvertFloatFunction)(const float* src, int cols, const float* offset, const float* scale,
+                                     float* dst, int paddedCols);
+
+struct ConvertKernel
+{
+    const char* name;
+    ConvertFunction real;
+    ConvertFunction complex;
+    ConvertFloatFunction realFloat;
+    ConvertFloatFunction complexFloat;
+};
+
+// Every kernel is a template over the pixel type, uint16 readout or the
+// float rows of a binned band; only the load differs.
+
+// Offset and scale are NULL when unused; the tests are the same for every
+// pixel, so they cost nothing after the first.
+template<typename T>
+static inline float Pixel(const T* src, const float* offset, const float* scale, int c)
+{
+    float value = src[c];
+    if( offset )
+        value -= offset[c];
+    if( scale )
+        value *= scale[c];
+    return value;
+}
+
+template<typename T>
+static void ConvertScalar(const T* src, int cols, const float* offset, const float* scale,
+                          float* dst, int paddedCols)
+{
+    for( int c = 0; c < cols; c++ )
+        dst[c] = Pixel( src, offset, scale, c );
+    std::fill( dst + cols, dst + paddedCols, 0.0f );
+}
+
+template<typename T>
+static void ConvertComplexScalar(const T* src, int cols, const float* offset, const float* scale,
+                                 float* dst, int paddedCols)
+{
+    for( int c = 0; c < cols; c++ )
+    {
+        dst[2 * c] = Pixel( src, offset, scale, c );
+        dst[2 * c + 1] = 0.0f;
+    }
+    std::fill( dst + 2 * cols, dst + 2 * paddedCols, 0.0f );
+}
+
+#ifdef ROWCONVERT_X86
+
+// eight pixels from src + c as float: zero extended to 32 bits and
+// converted, or loaded as they are
+__attribute__((target("avx2")))
+static inline __m256 Widen8(const unsigned short* src, int c)
+{
+    return _mm256_cvtepi32_ps( _mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i*)( src + c ) ) ) );
+}
+
+__attribute__((target("avx2")))
+static inline __m256 Widen8(const float* src, int c)
+{
+    return _mm256_loadu_ps( src + c );
+}
+
+// the same, corrected
+template<typename T>
+__attribute__((target("avx2")))
+static inline __m256 Load8(const T* src, const float* offset, const float* scale, int c)
+{
+    __m256 value = Widen8( src, c );
+    if( offset )
+        value = _mm256_sub_ps( value, _mm256_loadu_ps( offset + c ) );
+    if( scale )
+        value = _mm256_mul_ps( value, _mm256_loadu_ps( scale + c ) );
+    return value;
+}
+
+template<typename T>
+__attribute__((target("avx2")))
+static void ConvertAvx2(const T* src, int cols, const float* offset, const float* scale,
+                        float* dst, int paddedCols)
+{
+    int c = 0;
+    for( ; c + 8 <= cols; c += 8 )
+        _mm256_storeu_ps( dst + c, Load8( src, offset, scale, c ) );
+    for( ; c < cols; c++ )
+        dst[c] = Pixel( src, offset, scale, c );
+    std::fill( dst + cols, dst + paddedCols, 0.0f );
+}
+
+template<typename T>
+__attribute__((target("avx2")))
+static void ConvertComplexAvx2(const T* src, int cols, const float* offset, const float* scale,
+                               float* dst, int paddedCols)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    int c = 0;
+    for( ; c + 8 <= cols; c += 8 )
+    {
+        // unpack pairs within each 128-bit lane, then put the lanes in order
+        __m256 value = Load8( src, offset, scale, c );
+        __m256 low = _mm256_unpacklo_ps( value, zero );    // v0 0 v1 0 | v4 0 v5 0
+        __m256 high = _mm256_unpackhi_ps( value, zero );   // v2 0 v3 0 | v6 0 v7 0
+        _mm256_storeu_ps( dst + 2 * c, _mm256_permute2f128_ps( low, high, 0x20 ) );
+        _mm256_storeu_ps( dst + 2 * c + 8, _mm256_permute2f128_ps( low, high, 0x31 ) );
+    }
+    for( ; c < cols; c++ )
+    {
+        dst[2 * c] = Pixel( src, offset, scale, c );
+        dst[2 * c + 1] = 0.0f;
+    }
+    std::fill( dst + 2 * cols, dst + 2 * paddedCols, 0.0f );
+}
+
+__attribute__((target("avx512f")))
+static inline __m512 Widen16(const unsigned short* src, int c)
+{
+    // the zero-masked forms with every lane set: the plain intrinsics start
+    // from an undefined register, which GCC 12 flags as maybe-uninitialized
+    const __mmask16 all = 0xffff;
+    __m512i wide = _mm512_maskz_cvtepu16_epi32( all, _mm256_loadu_si256( (const __m256i*)( src + c ) ) );
+    return _mm512_maskz_cvtepi32_ps( all, wide );
+}
+
+__attribute__((target("avx512f")))
+static inline __m512 Widen16(const float* src, int c)
+{
+    return _mm512_loadu_ps( src + c );
+}
+
+template<typename T>
+__attribute__((target("avx512f")))
+static inline __m512 Load16(const T* src, const float* offset, const float* scale, int c)
+{
+    __m512 value = Widen16( src, c );
+    if( offset )
+        value = _mm512_sub_ps( value, _mm512_loadu_ps( offset + c ) );
+    if( scale )
+        value = _mm512_mul_ps( value, _mm512_loadu_ps( scale + c ) );
+    return value;
+}
+
+template<typename T>
+__attribute__((target("avx512f")))
+static void ConvertAvx512(const T* src, int cols, const float* offset, const float* scale,
+                          float* dst, int paddedCols)
+{
+    int c = 0;
+    for( ; c + 16 <= cols; c += 16 )
+        _mm512_storeu_ps( dst + c, Load16( src, offset, scale, c ) );
+    for( ; c < cols; c++ )
+        dst[c] = Pixel( src, offset, scale, c );
+    std::fill( dst + cols, dst + paddedCols, 0.0f );
+}
+
+template<typename T>
+__attribute__((target("avx512f")))
+static void ConvertComplexAvx512(const T* src, int cols, const float* offset, const float* scale,
+                                 float* dst, int paddedCols)
+{
+    // every value to an even lane, odd lanes masked to zero
+    const __m512i low = _mm512_set_epi32( 7, 7, 6, 6, 5, 5, 4, 4, 3, 3, 2, 2, 1, 1, 0, 0 );
+    const __m512i high = _mm512_set_epi32( 15, 15, 14, 14, 13, 13, 12, 12, 11, 11, 10, 10, 9, 9, 8, 8 );
+    const __mmask16 real = 0x5555;
+    int c = 0;
+    for( ; c + 16 <= cols; c += 16 )
+    {
+        __m512 value = Load16( src, offset, scale, c );
+        _mm512_storeu_ps( dst + 2 * c, _mm512_maskz_permutexvar_ps( real, low, value ) );
+        _mm512_storeu_ps( dst + 2 * c + 16, _mm512_maskz_permutexvar_ps( real, high, value ) );
+    }
+    for( ; c < cols; c++ )
+    {
+        dst[2 * c] = Pixel( src, offset, scale, c );
+        dst[2 * c + 1] = 0.0f;
+    }
+    std::fill( dst + 2 * cols, dst + 2 * paddedCols, 0.0f );
+}
+
+#endif
+
+// fastest first
+static const ConvertKernel kernels[] =
+{
+#ifdef ROWCONVERT_X86
+    { "avx512", ConvertAvx512<unsigned short>, ConvertComplexAvx512<unsigned short>,
+                ConvertAvx512<float>,          ConvertComplexAvx512<float> },
+    { "avx2",   ConvertAvx2<unsigned short>,   ConvertComplexAvx2<unsigned short>,
+                ConvertAvx2<float>,            ConvertComplexAvx2<float> },
+#endif
+    { "scalar", ConvertScalar<unsigned short>, ConvertComplexScalar<unsigned short>,
+                ConvertScalar<float>,          ConvertComplexScalar<float> },
+};
+static const int kernelCount = sizeof(kernels) / sizeof(kernels[0]);
+
+static bool Supported(const ConvertKernel& kernel)
+{
+#ifdef ROWCONVERT_X86
+    __builtin_cpu_init();
+    if( kernel.real == ConvertAvx512<unsigned short> )
+        return __builtin_cpu_supports( "avx512f" );
+    if( kernel.real == ConvertAvx2<unsigned short> )
+        return __builtin_cpu_supports( "avx2" );
+#endif
+    return true;
+}
+
+RowConverter::RowConverter(int rows, int cols)
+    : rows(rows),
+      cols(cols),
+      kernel(NULL),
+      calibration(NULL),
+      window(WindowNone)
+{
+    for( int k = 0; k < kernelCount && !kernel; k++ )
+        if( Supported( kernels[k] ) )
+            kernel = &kernels[k];
+}
+
+void RowConverter::SetCalibration(const Calibration* calibration)
+{
+    this->calibration = calibration;
+    UpdateScale();
+}
+
+// The usual symmetric windows over the cols pixels (the padding stays
+// zero): a0 - a1 cos(2 pi n / (cols - 1)) + a2 cos(4 pi n / (cols - 1)).
+void RowConverter::SetWindow(RowWindow window)
+{
+    this->window = window;
+    weights.clear();
+    double a0 = 1, a1 = 0, a2 = 0;
+    switch( window )
+    {
+    case WindowHann:     a0 = 0.5;  a1 = 0.5;  break;
+    case WindowHamming:  a0 = 0.54; a1 = 0.46; break;
+    case WindowBlackman: a0 = 0.42; a1 = 0.5;  a2 = 0.08; break;
+    default:             break;
+    }
+    if( window != WindowNone )
+    {
+        weights.resize( cols, 1.0f );
+        for( int c = 0; c < cols && cols > 1; c++ )
+        {
+            double x = 2 * M_PI * c / ( cols - 1 );
+            weights[c] = (float)( a0 - a1 * cos( x ) + a2 * cos( 2 * x ) );
+        }
+    }
+    UpdateScale();
+}
+
+void RowConverter::UpdateScale()
+{
+    scale.clear();
+    if( !calibration || weights.empty() )
+        return;
+    scale.resize( (size_t)rows * cols );
+    for( int r = 0; r < rows; r++ )
+    {
+        const float* gain = calibration->Gain( r );
+        for( int c = 0; c < cols; c++ )
+            scale[(size_t)r * cols + c] = gain[c] * weights[c];
+    }
+}
+
+const float* RowConverter::Offset(int r) const
+{
+    return calibration ? calibration->Offset( r ) : NULL;
+}
+
+const float* RowConverter::Scale(int r) const
+{
+    if( !scale.empty() )
+        return &scale[(size_t)r * cols];
+    if( calibration )
+        return calibration->Gain( r );
+    return weights.empty() ? NULL : &weights[0];
+}
+
+void RowConverter::ConvertRow(int r, const unsigned short* src, float* dst, int paddedCols) const
+{
+    kernel->real( src, cols, Offset( r ), Scale( r ), dst, paddedCols );
+}
+
+void RowConverter::ConvertComplexRow(int r, const unsigned short* src, float* dst, int paddedCols) const
+{
+    kernel->complex( src, cols, Offset( r ), Scale( r ), dst, paddedCols );
+}
+
+void RowConverter::ConvertRow(int r, const float* src, float* dst, int paddedCols) const
+{
+    kernel->realFloat( src, cols, Offset( r ), Scale( r ), dst, paddedCols );
+}
+
+void RowConverter::ConvertComplexRow(int r, const float* src, float* dst, int paddedCols) const
+{
+    kernel->complexFloat( src, cols, Offset( r ), Scale( r ), dst, paddedCols );
+}
+
+bool RowConverter::UseKernel(const std::string& name)
+{
+    for( int k = 0; k < kernelCount; k++ )
+    {
+        if( name == kernels[k].name && Supported( kernels[k] ) )
+        {
+            kernel = &kernels[k];
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* RowConverter::Kernel() const
+{
+    return kernel->name;
+}
+
+std::vector<std::string> RowConverter::Kernels()
+{
+    std::vector<std::string> names;
+    for( int k = 0; k < kernelCount; k++ )
+        if( Supported( kernels[k] ) )
+            names.push_back( kernels[k].name );
+    return names;
+}
+
+bool RowConverter::ParseWindow(const std::string& name, RowWindow* window)
+{
+    for( int w = WindowNone; w <= WindowBlackman; w++ )
+    {
+        if( name == WindowName( w ) )
+        {
+            *window = (RowWindow)w;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* RowConverter::WindowName(int window)
+{
+    switch( window )
+    {
+    case WindowNone:     return "none";
+    case WindowHann:     return "hann";
+    case WindowHamming:  return "hamming";
+    case WindowBlackman: return "blackman";
+    default:             return "unknown";
+    }
+}
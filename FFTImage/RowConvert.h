@@ -0,0 +1,85 @@
+// The one pass from 16-bit readout to the float rows the transforms take.
+//
+// Every ROI row is read once and written once: each pixel is converted to
+// float, corrected ((pixel - offset) * gain, if calibrating), multiplied
+// by the window (if any), and stored straight into the transform's input
+// row, followed by the zeros that pad it to the transform length.  The
+// gain and the window are folded into one table up front, so the kernel
+// costs the same whichever of them are in use.
+//
+// The kernels are written with AVX-512 and AVX2 intrinsics (16 and 8
+// pixels per step) and the fastest one the CPU supports is picked at run
+// time, so the binary still runs anywhere; the scalar kernel is the
+// fallback and the reference.  The complex form writes interleaved
+// (value, 0) pairs, which is what the c2c plans and OpenCV's dft() take,
+// without a separate zero imaginary plane to merge in.  The same kernels
+// take float pixels, for the band --fvb averages into one row.
+
+#ifndef ROWCONVERT_H
+#define ROWCONVERT_H
+
+#include <string>
+#include <vector>
+
+class Calibration;
+struct ConvertKernel;
+
+enum RowWindow
+{
+    WindowNone,
+    WindowHann,
+    WindowHamming,
+    WindowBlackman
+};
+
+class RowConverter
+{
+public:
+    RowConverter(int rows, int cols);
+
+    // Correct every pixel (NULL for raw counts) and weight every row with
+    // window; set both before the first conversion.
+    void SetCalibration(const Calibration* calibration);
+    void SetWindow(RowWindow window);
+
+    // ROI row r, cols pixels at src, into paddedCols floats at dst
+    void ConvertRow(int r, const unsigned short* src, float* dst, int paddedCols) const;
+    // the same into the real parts of paddedCols interleaved complex
+    // values at dst, with zero imaginary parts
+    void ConvertComplexRow(int r, const unsigned short* src, float* dst, int paddedCols) const;
+    // the same from float pixels
+    void ConvertRow(int r, const float* src, float* dst, int paddedCols) const;
+    void ConvertComplexRow(int r, const float* src, float* dst, int paddedCols) const;
+
+    // what row r is offset by and multiplied by, NULL for nothing
+    const float* Offset(int r) const;
+    const float* Scale(int r) const;
+
+    // Run the named kernel (avx512, avx2 or scalar) instead of the fastest;
+    // false if this CPU cannot.
+    bool UseKernel(const std::string& name);
+    const char* Kernel() const;
+    // the kernels this CPU runs, fastest first
+    static std::vector<std::string> Kernels();
+
+    RowWindow Window() const { return window; }
+    int Rows() const { return rows; }
+    int Cols() const { return cols; }
+
+    // none, hann, hamming or blackman
+    static bool ParseWindow(const std::string& name, RowWindow* window);
+    static const char* WindowName(int window);
+
+private:
+    void UpdateScale();
+
+    int rows;
+    int cols;
+    const ConvertKernel* kernel;
+    const Calibration* calibration;
+    RowWindow window;
+    std::vector<float> weights;         // cols window weights
+    std::vector<float> scale;           // rows x cols gain * weight, if both
+};
+
+#endif
@@ -0,0 +1,234 @@
+#include "RowFFT.h"
+#include "RowConvert.h"
+
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+
+RowFFT::RowFFT(int rows, int cols, int paddedCols, unsigned planFlags, bool halfSpectrum, int threads)
+    : rows(rows),
+      cols(cols),
+      paddedCols(paddedCols),
+      outputCols(halfSpectrum ? paddedCols / 2 + 1 : paddedCols),
+      inputStride(halfSpectrum ? ( paddedCols + 15 ) / 16 * 16 : ( paddedCols + 7 ) / 8 * 8),
+      halfSpectrum(halfSpectrum),
+      realIn(NULL),
+      in(NULL),
+      jobConverter(NULL),
+      jobFrame(NULL),
+      jobFloat(false),
+      jobStride(0),
+      generation(0),
+      pending(0),
+      quit(false)
+{
+    size_t inputSize = (size_t)rows * inputStride;
+    out = (fftwf_complex*) fftwf_malloc( sizeof(fftwf_complex) * rows * outputCols );
+    if( halfSpectrum )
+        realIn = (float*) fftwf_malloc( sizeof(float) * inputSize );
+    else
+        in = (fftwf_complex*) fftwf_malloc( sizeof(fftwf_complex) * inputSize );
+
+    if( threads < 1 )
+        threads = 1;
+    if( threads > rows )
+        threads = rows;
+
+    // planning with MEASURE/PATIENT scribbles over the arrays, so plan
+    // first and clear the input afterwards.  The FFTW planner is not
+    // thread safe: every plan is made here, before any worker starts.
+    plan = PlanRows( 0, rows, planFlags );
+    for( int t = 0; t < threads; t++ )
+    {
+        Slice slice;
+        slice.firstRow = rows * t / threads;
+        slice.rowCount = rows * (t + 1) / threads - slice.firstRow;
+        slice.plan = threads == 1 ? plan : PlanRows( slice.firstRow, slice.rowCount, planFlags );
+        slice.busySeconds = 0;
+        slice.transforms = 0;
+        slices.push_back( slice );
+    }
+
+    if( halfSpectrum )
+        memset( realIn, 0, sizeof(float) * inputSize );
+    else
+        memset( in, 0, sizeof(fftwf_complex) * inputSize );
+
+    for( int t = 1; t < threads; t++ )
+        workers.push_back( std::thread(&RowFFT::WorkerLoop, this, t) );
+    started = Clock::now();
+}
+
+RowFFT::~RowFFT()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        quit = true;
+    }
+    wake.notify_all();
+    for( size_t t = 0; t < workers.size(); t++ )
+        workers[t].join();
+
+    for( size_t t = 0; t < slices.size(); t++ )
+        if( slices[t].plan != plan )
+            fftwf_destroy_plan( slices[t].plan );
+    fftwf_destroy_plan( plan );
+    fftwf_free( realIn );
+    fftwf_free( in );
+    fftwf_free( out );
+}
+
+fftwf_plan RowFFT::PlanRows(int firstRow, int rowCount, unsigned planFlags)
+{
+    int n[] = { paddedCols };
+    fftwf_complex* rowsOut = out + (size_t)firstRow * outputCols;
+    if( halfSpectrum )
+        return fftwf_plan_many_dft_r2c( 1, n, rowCount,
+                                        realIn + (size_t)firstRow * inputStride, NULL, 1, inputStride,
+                                        rowsOut, NULL, 1, outputCols,
+                                        planFlags );
+    return fftwf_plan_many_dft( 1, n, rowCount,
+                                in + (size_t)firstRow * inputStride, NULL, 1, inputStride,
+                                rowsOut, NULL, 1, outputCols,
+                                FFTW_FORWARD, planFlags );
+}
+
+template<typename T>
+void RowFFT::LoadRows(int firstRow, int rowCount, const RowConverter& converter,
+                      const T* frame, int stride)
+{
+    for( int r = firstRow; r < firstRow + rowCount; r++ )
+    {
+        const T* src = frame + (size_t)r * stride;
+        if( halfSpectrum )
+            converter.ConvertRow( r, src, realIn + (size_t)r * inputStride, paddedCols );
+        else
+            converter.ConvertComplexRow( r, src, (float*)( in + (size_t)r * inputStride ), paddedCols );
+    }
+}
+
+void RowFFT::Load(const RowConverter& converter, const unsigned short* frame, int stride)
+{
+    LoadRows( 0, rows, converter, frame, stride );
+}
+
+void RowFFT::Load(const RowConverter& converter, const float* frame, int stride)
+{
+    LoadRows( 0, rows, converter, frame, stride );
+}
+
+void RowFFT::Execute()
+{
+    fftwf_execute( plan );
+}
+
+void RowFFT::RunSlice(Slice& slice)
+{
+    Clock::time_point start = Clock::now();
+    if( jobFloat )
+        LoadRows( slice.firstRow, slice.rowCount, *jobConverter, (const float*)jobFrame, jobStride );
+    else
+        LoadRows( slice.firstRow, slice.rowCount, *jobConverter, (const unsigned short*)jobFrame, jobStride );
+    fftwf_execute( slice.plan );
+    slice.busySeconds += std::chrono::duration<double>( Clock::now() - start ).count();
+    slice.transforms++;
+}
+
+void RowFFT::Transform(const RowConverter& converter, const unsigned short* frame, int stride)
+{
+    Run( converter, frame, false, stride );
+}
+
+void RowFFT::Transform(const RowConverter& converter, const float* frame, int stride)
+{
+    Run( converter, frame, true, stride );
+}
+
+void RowFFT::Run(const RowConverter& converter, const void* frame, bool floatFrame, int stride)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        jobConverter = &converter;
+        jobFrame = frame;
+        jobFloat = floatFrame;
+        jobStride = stride;
+        pending = (int)workers.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    RunSlice( slices[0] );
+
+    std::unique_lock<std::mutex> guard(lock);
+    while( pending > 0 )
+        finished.wait( guard );
+}
+
+void RowFFT::WorkerLoop(int index)
+{
+    long long seen = 0;
+    for( ;; )
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while( generation == seen && !quit )
+                wake.wait( guard );
+            if( quit )
+                return;
+            seen = generation;
+        }
+
+        RunSlice( slices[index] );
+
+        std::lock_guard<std::mutex> guard(lock);
+        if( --pending == 0 )
+            finished.notify_one();
+    }
+}
+
+void RowFFT::PrintUtilisation() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    double wall = std::chrono::duration<double>( Clock::now() - started ).count();
+    std::ios state( NULL );
+    state.copyfmt( std::cout );
+
+    std::cout << "Row FFT: " << slices.size() << " thread(s), "
+              << ( halfSpectrum ? "r2c" : "c2c" ) << ", " << rows << "x" << paddedCols << "\n";
+    for( size_t t = 0; t < slices.size(); t++ )
+    {
+        const Slice& s = slices[t];
+        std::cout << "    thread " << t << ": rows " << s.firstRow << "-" << s.firstRow + s.rowCount - 1
+                  << std::fixed << std::setprecision(1)
+                  << ", busy " << ( wall > 0 ? 100.0 * s.busySeconds / wall : 0.0 ) << "%"
+                  << std::setprecision(3)
+                  << ", " << ( s.transforms ? 1e3 * s.busySeconds / s.transforms : 0.0 ) << " ms/frame"
+                  << std::endl;
+    }
+    std::cout.copyfmt( state );
+}
+
+bool RowFFT::ParsePlanFlags(const std::string& rigor, unsigned* flags)
+{
+    if( rigor == "estimate" )
+        *flags = FFTW_ESTIMATE;
+    else if( rigor == "measure" )
+        *flags = FFTW_MEASURE;
+    else if( rigor == "patient" )
+        *flags = FFTW_PATIENT;
+    else if( rigor == "exhaustive" )
+        *flags = FFTW_EXHAUSTIVE;
+    else
+        return false;
+    return true;
+}
+
+bool RowFFT::ImportWisdom(const std::string& path)
+{
+    return !path.empty() && fftwf_import_wisdom_from_filename( path.c_str() );
+}
+
+bool RowFFT::ExportWisdom(const std::string& path)
+{
+    return !path.empty() && fftwf_export_wisdom_to_filename( path.c_str() );
+}
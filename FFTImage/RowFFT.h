@@ -0,0 +1,123 @@
+// FFTW engine for the per-row transforms in FFTimage.
+//
+// The rows of a frame are transformed by batched fftwf_plan_many_dft(_r2c)
+// plans.  The plans are built once for the sensor geometry (with
+// FFTW_MEASURE or FFTW_PATIENT, so startup pays for the planning, not each
+// frame) and executed on the same aligned buffers for every shot.
+// Planning results can be kept in a wisdom file so a PATIENT plan is only
+// searched for once per machine.
+//
+// The frames are real, so by default the rows go through a real-to-complex
+// (r2c) plan that keeps only the paddedCols/2 + 1 non-redundant bins; the
+// full complex (c2c) transform is still available for comparison.  Input
+// rows are spaced a multiple of 64 bytes apart, so every row of the batch
+// starts as aligned as the first and FFTW can use its SIMD codelets on
+// all of them; RowConverter fills them straight from the 16-bit frame,
+// or from the float row of a binned band.
+//
+// With more than one thread the rows are split into contiguous slices,
+// each with its own plan, and Transform() converts and transforms the
+// slices in parallel: the calling thread takes the first slice and a
+// worker thread each of the others.  Every slice keeps track of how long
+// it was busy so the thread count can be sized from PrintUtilisation().
+
+#ifndef ROWFFT_H
+#define ROWFFT_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <fftw3.h>
+
+class RowConverter;
+
+class RowFFT
+{
+public:
+    // rows x cols frame, each row zero padded to paddedCols before the
+    // transform.  planFlags is FFTW_ESTIMATE, FFTW_MEASURE or FFTW_PATIENT.
+    RowFFT(int rows, int cols, int paddedCols, unsigned planFlags,
+           bool halfSpectrum = true, int threads = 1);
+    ~RowFFT();
+
+    // convert a 16-bit frame (stride in pixels) into the input rows with
+    // converter and transform them, spread over all threads
+    void Transform(const RowConverter& converter, const unsigned short* frame, int stride);
+    void Transform(const RowConverter& converter, const float* frame, int stride);
+
+    // the same two steps on the calling thread only
+    void Load(const RowConverter& converter, const unsigned short* frame, int stride);
+    void Load(const RowConverter& converter, const float* frame, int stride);
+    void Execute();
+
+    // rows x OutputCols() interleaved complex spectrum
+    const fftwf_complex* Output() const { return out; }
+
+    int Rows() const { return rows; }
+    int Cols() const { return cols; }
+    int PaddedCols() const { return paddedCols; }
+    int OutputCols() const { return outputCols; }
+    bool HalfSpectrum() const { return halfSpectrum; }
+    int Threads() const { return (int)slices.size(); }
+
+    void PrintUtilisation() const;
+
+    // planner flags for estimate, measure, patient or exhaustive; false
+    // for anything else
+    static bool ParsePlanFlags(const std::string& rigor, unsigned* flags);
+    static bool ImportWisdom(const std::string& path);
+    static bool ExportWisdom(const std::string& path);
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Slice
+    {
+        int firstRow;
+        int rowCount;
+        fftwf_plan plan;
+        double busySeconds;
+        long long transforms;
+    };
+
+    fftwf_plan PlanRows(int firstRow, int rowCount, unsigned planFlags);
+    template<typename T>
+    void LoadRows(int firstRow, int rowCount, const RowConverter& converter,
+                  const T* frame, int stride);
+    void Run(const RowConverter& converter, const void* frame, bool floatFrame, int stride);
+    void RunSlice(Slice& slice);
+    void WorkerLoop(int index);
+
+    int rows;
+    int cols;
+    int paddedCols;
+    int outputCols;
+    int inputStride;                // floats (r2c) or complex values (c2c) between input rows
+    bool halfSpectrum;
+
+    float* realIn;                  // r2c input
+    fftwf_complex* in;              // c2c input
+    fftwf_complex* out;
+    fftwf_plan plan;                // all rows, for Execute()
+
+    std::vector<Slice> slices;
+    std::vector<std::thread> workers;
+    Clock::time_point started;
+
+    // current job, handed to the workers under lock
+    const RowConverter* jobConverter;
+    const void* jobFrame;           // uint16, or float with jobFloat
+    bool jobFloat;
+    int jobStride;
+    long long generation;
+    int pending;
+    bool quit;
+    mutable std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable finished;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#include "RowTransform.h"
+
+using namespace cv;
+
+void TransformRows(const Mat& roi, RowFFT* rowFFT, const RowConverter& converter,
+                   FFTWorkspace& workspace, Mat spectrum[2], StageTimes* times)
+{
+    StageTimes::Clock::time_point mark = StageTimes::Clock::now();
+    if( rowFFT )
+    {
+        // all rows in one batched FFTW call, straight from the 16-bit frame
+        // (or the float band mean); with r2c only the non-redundant half
+        // spectrum comes back
+        if( roi.depth() == CV_32F )
+            rowFFT->Transform( converter, roi.ptr<float>(0), (int)roi.step1() );
+        else
+            rowFFT->Transform( converter, roi.ptr<unsigned short>(0), (int)roi.step1() );
+        MarkStage( times, StageTransform, mark );
+        Mat output( rowFFT->Rows(), rowFFT->OutputCols(), CV_32FC2, (void*)rowFFT->Output() );
+        split( output, spectrum );                  // spectrum[0] = Re(DFT(I), spectrum[1] = Im(DFT(I))
+        MarkStage( times, StageSplit, mark );
+        return;
+    }
+
+    // straight into the interleaved input dft() takes, imaginary parts
+    // and padding zeroed on the way
+    for( int r = 0; r < roi.rows; r++ )
+    {
+        if( roi.depth() == CV_32F )
+            converter.ConvertComplexRow( r, roi.ptr<float>(r), workspace.complexI.ptr<float>(r),
+                                         workspace.complexI.cols );
+        else
+            converter.ConvertComplexRow( r, roi.ptr<unsigned short>(r), workspace.complexI.ptr<float>(r),
+                                         workspace.complexI.cols );
+    }
+    MarkStage( times, StageConvert, mark );
+
+    dft( workspace.complexI, workspace.complexI, DFT_ROWS );   // this way the result may fit in the source matrix
+    MarkStage( times, StageTransform, mark );
+
+    split( workspace.complexI, spectrum );          // spectrum[0] = Re(DFT(I), spectrum[1] = Im(DFT(I))
+    MarkStage( times, StageSplit, mark );
+}
@@ -0,0 +1,27 @@
+// The row transform FFTimage applies to the ROI of every shot.
+//
+// It lives on its own so that fftbench times exactly the code the
+// acquisition loop runs, with either engine.
+
+#ifndef ROWTRANSFORM_H
+#define ROWTRANSFORM_H
+
+#include <opencv2/core/core.hpp>
+#include "RowFFT.h"
+#include "RowConvert.h"
+#include "FFTWorkspace.h"
+#include "StageProfile.h"
+
+// Transform the rows of the ROI into spectrum[0] = Re(DFT) and
+// spectrum[1] = Im(DFT), with FFTW if rowFFT is set and OpenCV otherwise.
+// Either way converter turns the pixels (uint16, or float for a binned
+// band) into corrected, windowed and zero padded float rows in one pass.
+// The OpenCV engine works in workspace.complexI, which FFTW leaves alone.
+// When that and spectrum are preallocated at the right size and type,
+// none of these calls allocate.
+// With times set each step is timed; RowFFT converts each slice of rows
+// as it transforms it, so with FFTW the conversion counts as transform.
+void TransformRows(const cv::Mat& roi, RowFFT* rowFFT, const RowConverter& converter,
+                   FFTWorkspace& workspace, cv::Mat spectrum[2], StageTimes* times);
+
+#endif
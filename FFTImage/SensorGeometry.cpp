@@ -0,0 +1,113 @@
+#include "SensorGeometry.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+PicamRoi FullSensorRoi()
+{
+    PicamRoi roi;
+    roi.x = 0;
+    roi.width = SENSOR_COLS;
+    roi.x_binning = 1;
+    roi.y = 0;
+    roi.height = SENSOR_ROWS;
+    roi.y_binning = 1;
+    return roi;
+}
+
+bool ParseSensorRoi(const char* text, PicamRoi* roi)
+{
+    int x, y, width, height;
+    if( sscanf( text, "%d,%d,%d,%d", &x, &y, &width, &height ) != 4 )
+        return false;
+    roi->x = x;
+    roi->y = y;
+    roi->width = width;
+    roi->height = height;
+    return true;
+}
+
+bool ParseFrameRange(const char* text, int offset, int binning, int size, int* first, int* last)
+{
+    *first = 0;
+    *last = size;
+    if( text[0] == '\0' || strcmp( text, "all" ) == 0 )
+        return true;
+
+    int a, b;
+    if( sscanf( text, "%d:%d", &a, &b ) != 2 || b <= a )
+        return false;
+
+    // the frame covers sensor pixels offset up to end
+    int end = offset + size * binning;
+    if( b <= offset || a >= end )
+    {
+        printf( "Range %d:%d lies outside the read-out pixels %d:%d\n", a, b, offset, end );
+        return false;
+    }
+    if( a < offset || b > end )
+    {
+        a = std::max( a, offset );
+        b = std::min( b, end );
+        printf( "Range clipped to the read-out pixels %d:%d\n", a, b );
+    }
+    *first = ( a - offset ) / binning;
+    *last = ( b - offset + binning - 1 ) / binning;
+    return true;
+}
+
+bool GetFrameGeometry(PicamHandle camera, FrameGeometry* geometry)
+{
+    // the ROI reads back as set, which is only what the camera delivers
+    // once it has been committed
+    pibln committed = false;
+    if( Picam_AreParametersCommitted( camera, &committed ) != PicamError_None || !committed )
+    {
+        printf( "Camera parameters are not committed\n" );
+        return false;
+    }
+
+    const PicamRois* rois;
+    if( Picam_GetParameterRoisValue( camera, PicamParameter_Rois, &rois ) != PicamError_None )
+        return false;
+    if( rois->roi_count != 1 )
+    {
+        printf( "Expected one ROI, camera has %d\n", (int)rois->roi_count );
+        Picam_DestroyRois( rois );
+        return false;
+    }
+
+    const PicamRoi& roi = rois->roi_array[0];
+    geometry->x = roi.x;
+    geometry->y = roi.y;
+    geometry->xBinning = roi.x_binning;
+    geometry->yBinning = roi.y_binning;
+    geometry->rows = roi.height / roi.y_binning;
+    geometry->cols = roi.width / roi.x_binning;
+    Picam_DestroyRois( rois );
+
+    piint frameSize = 0, stride = 0;
+    if( Picam_GetParameterIntegerValue( camera, PicamParameter_FrameSize, &frameSize ) != PicamError_None
+        || Picam_GetParameterIntegerValue( camera, PicamParameter_ReadoutStride, &stride ) != PicamError_None )
+        return false;
+    geometry->frameBytes = frameSize;
+    geometry->readoutStride = stride;
+
+    // the frames are wrapped as rows x cols 16-bit images, so any other
+    // pixel format or padding would have them read the wrong pixels, or
+    // past the end of the readout
+    if( geometry->rows <= 0 || geometry->cols <= 0
+        || frameSize != (piint)( geometry->rows * geometry->cols * sizeof(pi16u) ) )
+    {
+        printf( "Frame size %d does not match a %dx%d ROI\n",
+                (int)frameSize, geometry->rows, geometry->cols );
+        return false;
+    }
+    if( stride < frameSize )
+    {
+        printf( "Readout stride %d is smaller than the %d byte frame\n", (int)stride, (int)frameSize );
+        return false;
+    }
+    return true;
+}
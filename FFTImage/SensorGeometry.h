@@ -0,0 +1,43 @@
+// Hardware ROI and binning for the PyLoN.
+//
+// Reading only part of the CCD (and binning on-chip) cuts the number of
+// pixels that go through the ADC, which is what limits the frame rate.
+// Once an ROI has been committed, the size of every frame has to come from
+// the camera rather than from the full 400x1340 sensor.
+
+#ifndef SENSORGEOMETRY_H
+#define SENSORGEOMETRY_H
+
+#include "picam.h"
+
+#define SENSOR_ROWS  400
+#define SENSOR_COLS  1340
+
+struct FrameGeometry
+{
+    int x, y;                   // sensor pixel at the start of the ROI
+    int xBinning, yBinning;
+    int rows, cols;             // pixels per frame after binning
+    int frameBytes;             // pixel data in one frame
+    int readoutStride;          // bytes from one readout to the next
+};
+
+// Full-sensor ROI, no binning.
+PicamRoi FullSensorRoi();
+
+// Parse "x,y,width,height"; false (and roi untouched) if malformed.
+bool ParseSensorRoi(const char* text, PicamRoi* roi);
+
+// Parse "first:last" in sensor pixels (last exclusive) and map it onto a
+// frame of size pixels read out from offset with the given binning.  An
+// empty string or "all" is the whole frame.  A range reaching past the
+// frame is clipped to it, with a warning; one that is malformed or misses
+// the frame altogether returns false.
+bool ParseFrameRange(const char* text, int offset, int binning, int size, int* first, int* last);
+
+// Geometry of the frames the camera will deliver with the committed ROI;
+// false if the parameters are not committed or the frames are not
+// rows x cols 16-bit pixels within the readout stride.
+bool GetFrameGeometry(PicamHandle camera, FrameGeometry* geometry);
+
+#endif
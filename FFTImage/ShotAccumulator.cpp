@@ -0,0 +1,122 @@
+#include "ShotAccumulator.h"
+
+#include <algorithm>
+
+ShotAccumulator::ShotAccumulator(int rows, int cols, int spectrumCols, bool coherent)
+    : rows(rows),
+      cols(cols),
+      spectrumCols(spectrumCols),
+      coherent(coherent && spectrumCols > 0),
+      shots(0)
+{
+    size_t frame = (size_t)rows * cols;
+    size_t spectrum = (size_t)rows * spectrumCols;
+    planes.resize( 2 * frame + 2 * spectrum + ( this->coherent ? 3 * spectrum : 0 ) );
+
+    frameMean = &planes[0];
+    frameVariance = frameMean + frame;
+    powerMean = frameVariance + frame;
+    powerVariance = powerMean + spectrum;
+    realMean = powerVariance + spectrum;
+    imagMean = realMean + spectrum;
+    complexVariance = imagMean + spectrum;
+
+    frameM2.resize( frame );
+    powerM2.resize( spectrum );
+    if( this->coherent )
+        complexM2.resize( spectrum );
+}
+
+void ShotAccumulator::Reset()
+{
+    shots = 0;
+    std::fill( planes.begin(), planes.end(), 0.0 );
+    std::fill( frameM2.begin(), frameM2.end(), 0.0 );
+    std::fill( powerM2.begin(), powerM2.end(), 0.0 );
+    std::fill( complexM2.begin(), complexM2.end(), 0.0 );
+}
+
+void ShotAccumulator::Add(const uint16_t* frame, size_t frameStride,
+                          const float* re, const float* im, size_t spectrumStride)
+{
+    shots++;
+    AddFrame( frame, frameStride );
+    AddSpectrum( re, im, spectrumStride );
+}
+
+void ShotAccumulator::Add(const float* frame, size_t frameStride,
+                          const float* re, const float* im, size_t spectrumStride)
+{
+    shots++;
+    AddFrame( frame, frameStride );
+    AddSpectrum( re, im, spectrumStride );
+}
+
+template<typename T>
+void ShotAccumulator::AddFrame(const T* frame, size_t frameStride)
+{
+    double weight = 1.0 / shots;
+    for( int r = 0; r < rows; r++ )
+    {
+        const T* x = frame + r * frameStride;
+        double* mean = frameMean + (size_t)r * cols;
+        double* m2 = &frameM2[(size_t)r * cols];
+        for( int c = 0; c < cols; c++ )
+        {
+            double delta = x[c] - mean[c];
+            mean[c] += delta * weight;
+            m2[c] += delta * ( x[c] - mean[c] );
+        }
+    }
+}
+
+void ShotAccumulator::AddSpectrum(const float* re, const float* im, size_t spectrumStride)
+{
+    if( spectrumCols == 0 )
+        return;
+
+    double weight = 1.0 / shots;
+
+    for( int r = 0; r < rows; r++ )
+    {
+        const float* a = re + r * spectrumStride;
+        const float* b = im + r * spectrumStride;
+        size_t row = (size_t)r * spectrumCols;
+        double* mean = powerMean + row;
+        double* m2 = &powerM2[row];
+        for( int c = 0; c < spectrumCols; c++ )
+        {
+            double power = (double)a[c] * a[c] + (double)b[c] * b[c];
+            double delta = power - mean[c];
+            mean[c] += delta * weight;
+            m2[c] += delta * ( power - mean[c] );
+        }
+
+        if( !coherent )
+            continue;
+        double* meanRe = realMean + row;
+        double* meanIm = imagMean + row;
+        double* m2c = &complexM2[row];
+        for( int c = 0; c < spectrumCols; c++ )
+        {
+            double deltaRe = a[c] - meanRe[c];
+            double deltaIm = b[c] - meanIm[c];
+            meanRe[c] += deltaRe * weight;
+            meanIm[c] += deltaIm * weight;
+            m2c[c] += deltaRe * ( a[c] - meanRe[c] ) + deltaIm * ( b[c] - meanIm[c] );
+        }
+    }
+}
+
+const double* ShotAccumulator::Planes()
+{
+    // sample variance; a single shot has none
+    double scale = shots > 1 ? 1.0 / ( shots - 1 ) : 0.0;
+    for( size_t i = 0; i < frameM2.size(); i++ )
+        frameVariance[i] = frameM2[i] * scale;
+    for( size_t i = 0; i < powerM2.size(); i++ )
+        powerVariance[i] = powerM2[i] * scale;
+    for( size_t i = 0; i < complexM2.size(); i++ )
+        complexVariance[i] = complexM2[i] * scale;
+    return &planes[0];
+}
@@ -0,0 +1,72 @@
+// Running statistics over a block of FFTimage shots.
+//
+// Instead of keeping N shots to average afterwards, every shot is folded
+// into running means and sums of squared deviations (Welford's update,
+// which stays accurate where the naive sum of squares cancels) for the
+// ROI frame, the power spectrum |X|^2 and, optionally, the complex
+// spectrum itself.  The coherent average keeps the phase, so it only
+// builds up signal that is phase-locked to the shots.  Memory is fixed
+// by the ROI size, however many shots go in.
+//
+// Each update is one pass over contiguous rows of the frame and the
+// spectrum planes with no dependency between elements, so the compiler
+// vectorises the inner loops (the build defaults to -O3 for that).
+// Planes() returns the results laid out as one statistics record of
+// RecordFile.h.
+
+#ifndef SHOTACCUMULATOR_H
+#define SHOTACCUMULATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+class ShotAccumulator
+{
+public:
+    // spectrumCols = 0 accumulates the frames only
+    ShotAccumulator(int rows, int cols, int spectrumCols, bool coherent);
+
+    // strides in elements; re and im are ignored without a spectrum
+    void Add(const uint16_t* frame, size_t frameStride,
+             const float* re, const float* im, size_t spectrumStride);
+    // the same with a float frame, such as a binned band
+    void Add(const float* frame, size_t frameStride,
+             const float* re, const float* im, size_t spectrumStride);
+    void Reset();
+
+    long long Shots() const { return shots; }
+
+    // frame mean and variance, then (with a spectrum) power mean and
+    // variance, then (coherent) mean Re, mean Im and complex variance;
+    // valid until the next Add()
+    const double* Planes();
+
+private:
+    template<typename T>
+    void AddFrame(const T* frame, size_t frameStride);
+    void AddSpectrum(const float* re, const float* im, size_t spectrumStride);
+
+    int rows;
+    int cols;
+    int spectrumCols;
+    bool coherent;
+    long long shots;
+
+    // output layout; the means are updated in place
+    std::vector<double> planes;
+    double* frameMean;
+    double* frameVariance;
+    double* powerMean;
+    double* powerVariance;
+    double* realMean;
+    double* imagMean;
+    double* complexVariance;
+
+    // sums of squared deviations, turned into variances by Planes()
+    std::vector<double> frameM2;
+    std::vector<double> powerM2;
+    std::vector<double> complexM2;
+};
+
+#endif
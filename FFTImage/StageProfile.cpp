@@ -0,0 +1,264 @@
+#include "StageProfile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <pthread.h>
+#include <signal.h>
+
+StageTimes::StageTimes(const std::string& name)
+    : name(name)
+{
+    for( int s = 0; s < StageCount; s++ )
+    {
+        Histogram& h = histograms[s];
+        h.count = 0;
+        h.sum = 0;
+        h.max = 0;
+        for( int b = 0; b < Buckets; b++ )
+            h.buckets[b] = 0;
+    }
+}
+
+// Exact below 16 ns, then 16 buckets between each power of two and the
+// next.
+int StageTimes::Bucket(long long nanoseconds)
+{
+    if( nanoseconds < SubBuckets )
+        return nanoseconds < 0 ? 0 : (int)nanoseconds;
+    int power = 63 - __builtin_clzll( (unsigned long long)nanoseconds );
+    int bucket = ( power - 3 ) * SubBuckets + (int)( ( nanoseconds >> ( power - 4 ) ) & ( SubBuckets - 1 ) );
+    return bucket < Buckets ? bucket : Buckets - 1;
+}
+
+long long StageTimes::BucketTop(int bucket)
+{
+    if( bucket < SubBuckets )
+        return bucket;
+    int power = bucket / SubBuckets + 3;
+    long long width = 1LL << ( power - 4 );
+    return ( SubBuckets + bucket % SubBuckets ) * width + width - 1;
+}
+
+void StageTimes::Add(Stage stage, long long nanoseconds)
+{
+    // this thread is the only writer, so load and store is enough
+    Histogram& h = histograms[stage];
+    std::atomic<long long>& bucket = h.buckets[Bucket( nanoseconds )];
+    bucket.store( bucket.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+    h.sum.store( h.sum.load( std::memory_order_relaxed ) + nanoseconds, std::memory_order_relaxed );
+    if( nanoseconds > h.max.load( std::memory_order_relaxed ) )
+        h.max.store( nanoseconds, std::memory_order_relaxed );
+    h.count.store( h.count.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+}
+
+StageProfile::StageProfile()
+    : started(StageTimes::Clock::now()),
+      quit(false)
+{
+}
+
+StageProfile::~StageProfile()
+{
+    if( signalThread.joinable() )
+    {
+        quit = true;
+        pthread_kill( signalThread.native_handle(), SIGUSR1 );
+        signalThread.join();
+    }
+    for( size_t t = 0; t < threads.size(); t++ )
+        delete threads[t];
+}
+
+StageTimes* StageProfile::AddThread(const std::string& name)
+{
+    threads.push_back( new StageTimes( name ) );
+    return threads.back();
+}
+
+const char* StageProfile::StageName(Stage stage)
+{
+    switch( stage )
+    {
+    case StageAcquire:   return "acquire";
+    case StageCopy:      return "copy";
+    case StageFilter:    return "filter";
+    case StageBin:       return "bin";
+    case StageConvert:   return "convert";
+    case StageTransform: return "transform";
+    case StageSplit:     return "split";
+    case StageTrack:     return "track";
+    case StagePreview:   return "preview";
+    case StageRecord:    return "record";
+    case StageHdf5:      return "hdf5";
+    case StageAverage:   return "average";
+    case StageSeries:    return "series";
+    case StageLatency:   return "latency";
+    default:             return "unknown";
+    }
+}
+
+// one thread's stage, or (times NULL) the stage summed over all threads
+StageProfile::Summary StageProfile::Summarise(Stage stage, const StageTimes* times) const
+{
+    Summary summary;
+    summary.count = 0;
+    summary.sum = 0;
+    summary.max = 0;
+    summary.buckets.assign( StageTimes::Buckets, 0 );
+    for( size_t t = 0; t < threads.size(); t++ )
+    {
+        if( times && threads[t] != times )
+            continue;
+        const StageTimes::Histogram& h = threads[t]->histograms[stage];
+        for( int b = 0; b < StageTimes::Buckets; b++ )
+            summary.buckets[b] += h.buckets[b].load( std::memory_order_relaxed );
+        summary.sum += h.sum.load( std::memory_order_relaxed );
+        summary.max = std::max( summary.max, h.max.load( std::memory_order_relaxed ) );
+    }
+    // count from the buckets, so percentiles agree with them even while
+    // a thread is half way through Add()
+    for( int b = 0; b < StageTimes::Buckets; b++ )
+        summary.count += summary.buckets[b];
+    return summary;
+}
+
+static long long Percentile(const std::vector<long long>& buckets, long long count, long long max, double p)
+{
+    long long rank = (long long)( p * count + 0.999999 );
+    long long seen = 0;
+    for( size_t b = 0; b < buckets.size(); b++ )
+    {
+        seen += buckets[b];
+        if( seen >= rank && seen > 0 )
+            return std::min( StageTimes::BucketTop( (int)b ), max );
+    }
+    return max;
+}
+
+static void WriteStage(std::ostream& out, const char* name, long long count, double sum, long long max,
+                       const std::vector<long long>& buckets, double seconds, bool histogram)
+{
+    out << "\"" << name << "\": { \"count\": " << count
+        << ", \"per_second\": " << ( seconds > 0 ? count / seconds : 0.0 )
+        << ", \"total_s\": " << sum * 1e-9
+        << ", \"mean_us\": " << ( count ? sum / count * 1e-3 : 0.0 )
+        << ", \"p50_us\": " << Percentile( buckets, count, max, 0.50 ) * 1e-3
+        << ", \"p99_us\": " << Percentile( buckets, count, max, 0.99 ) * 1e-3
+        << ", \"max_us\": " << max * 1e-3;
+    if( histogram )
+    {
+        // [largest value in the bucket, count] for every non-empty bucket
+        out << ", \"histogram_us\": [";
+        bool first = true;
+        for( size_t b = 0; b < buckets.size(); b++ )
+        {
+            if( !buckets[b] )
+                continue;
+            out << ( first ? "" : ", " ) << "[" << StageTimes::BucketTop( (int)b ) * 1e-3 << ", " << buckets[b] << "]";
+            first = false;
+        }
+        out << "]";
+    }
+    out << " }";
+}
+
+bool StageProfile::WriteJson(const std::string& path) const
+{
+    double seconds = std::chrono::duration<double>( StageTimes::Clock::now() - started ).count();
+
+    // written aside and renamed, so a reader never sees half a file
+    std::string temporary = path + ".tmp";
+    std::ofstream out( temporary.c_str() );
+    if( !out )
+    {
+        std::cout << "Cannot write profile " << path << "\n";
+        return false;
+    }
+    out << std::setprecision(6);
+    out << "{\n  \"seconds\": " << seconds << ",\n  \"stages\": {";
+    bool first = true;
+    for( int s = 0; s < StageCount; s++ )
+    {
+        Summary all = Summarise( (Stage)s, NULL );
+        if( !all.count )
+            continue;
+        out << ( first ? "\n    " : ",\n    " );
+        WriteStage( out, StageName( (Stage)s ), all.count, all.sum, all.max, all.buckets, seconds, true );
+        first = false;
+    }
+    out << "\n  },\n  \"threads\": [";
+    for( size_t t = 0; t < threads.size(); t++ )
+    {
+        out << ( t ? ",\n    " : "\n    " ) << "{ \"name\": \"" << threads[t]->Name() << "\", \"stages\": {";
+        first = true;
+        for( int s = 0; s < StageCount; s++ )
+        {
+            Summary one = Summarise( (Stage)s, threads[t] );
+            if( !one.count )
+                continue;
+            out << ( first ? "\n        " : ",\n        " );
+            WriteStage( out, StageName( (Stage)s ), one.count, one.sum, one.max, one.buckets, seconds, false );
+            first = false;
+        }
+        out << " } }";
+    }
+    out << "\n  ]\n}\n";
+    out.close();
+    if( !out || rename( temporary.c_str(), path.c_str() ) != 0 )
+    {
+        std::cout << "Cannot write profile " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+void StageProfile::PrintSummary() const
+{
+    std::ios state( NULL );
+    state.copyfmt( std::cout );
+    std::cout << "Stage latency (all threads):\n" << std::fixed << std::setprecision(1);
+    for( int s = 0; s < StageCount; s++ )
+    {
+        Summary all = Summarise( (Stage)s, NULL );
+        if( !all.count )
+            continue;
+        std::cout << "    " << std::left << std::setw(10) << StageName( (Stage)s ) << std::right
+                  << std::setw(8) << all.count << " x  p50 "
+                  << std::setw(9) << Percentile( all.buckets, all.count, all.max, 0.50 ) * 1e-3 << " us  p99 "
+                  << std::setw(9) << Percentile( all.buckets, all.count, all.max, 0.99 ) * 1e-3 << " us  max "
+                  << std::setw(9) << all.max * 1e-3 << " us\n";
+    }
+    std::cout << std::flush;
+    std::cout.copyfmt( state );
+}
+
+void StageProfile::DumpOnSignal(const std::string& path)
+{
+    dumpPath = path;
+    sigset_t signals;
+    sigemptyset( &signals );
+    sigaddset( &signals, SIGUSR1 );
+    pthread_sigmask( SIG_BLOCK, &signals, NULL );
+    signalThread = std::thread( &StageProfile::SignalLoop, this );
+}
+
+// Writing a file is not safe in a signal handler, so the signal is
+// blocked everywhere and taken here with sigwait() instead.
+void StageProfile::SignalLoop()
+{
+    sigset_t signals;
+    sigemptyset( &signals );
+    sigaddset( &signals, SIGUSR1 );
+    for( ;; )
+    {
+        int signal = 0;
+        sigwait( &signals, &signal );
+        if( quit )
+            return;
+        if( WriteJson( dumpPath ) )
+            std::cout << "Profile written to " << dumpPath << std::endl;
+    }
+}
@@ -0,0 +1,1061 @@
+// Offline PICam simulator.
+//
+// Implements the part of the PICam API used by SnapImage and FFTimage
+// against a single simulated PyLoN 400BR.  Frames are 400x1340 16-bit
+// images: a bias level, a horizontal band of interference fringes whose
+// phase drifts from frame to frame, shot noise and read noise.  A single
+// hardware ROI with on-chip binning is supported; binned pixels sum their
+// signal and pick up read noise once, as on the real CCD.
+//
+// The simulator is configured through the environment so the tools need
+// no changes to use it:
+//
+//   PICAM_SIM_FPS            readouts per second; 0 runs unpaced, unset
+//                            derives the rate from AdcSpeed and ExposureTime
+//   PICAM_SIM_FRINGE_PERIOD  period of the main fringe in pixels (16)
+//   PICAM_SIM_READ_NOISE     read noise in counts (6)
+//   PICAM_SIM_COMMIT_MS      time Picam_CommitParameters takes (0)
+//   PICAM_SIM_COOLING_S      sensor cooling time constant in seconds (30)
+//   PICAM_SIM_DROP_EVERY     lose every Nth readout in transfer (0 = none)
+//
+// Time stamps and frame tracking are appended to each readout when
+// enabled, laid out as on the real camera: after the pixels come the
+// exposure-started and exposure-ended stamps (whichever are enabled) and
+// then the frame-tracking number, each a 64-bit count.  Readouts lost
+// because the circular buffer is full, or dropped by PICAM_SIM_DROP_EVERY,
+// still use up a tracking number, so the gap is visible to the caller.
+
+#include "picam.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#define SIM_ROWS                400
+#define SIM_COLS                1340
+#define SIM_BIAS                600.0f
+#define SIM_AMBIENT_TEMP        20.0
+#define SIM_INTERNAL_READOUTS   64
+#define SIM_GAUSS_TABLE         65536
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+enum ValueType { Integer, LargeInteger, FloatingPoint };
+
+struct ParameterInfo
+{
+    PicamParameter parameter;
+    const char*    name;
+    ValueType      type;
+    bool           readOnly;
+    double         defaultValue;
+};
+
+const ParameterInfo parameterTable[] =
+{
+    { PicamParameter_ExposureTime,              "Exposure Time",               FloatingPoint, false, 10.0 },
+    { PicamParameter_ShutterTimingMode,         "Shutter Timing Mode",         Integer,       false, PicamShutterTimingMode_Normal },
+    { PicamParameter_SensorTemperatureSetPoint, "Sensor Temperature Set Point", FloatingPoint, false, -70.0 },
+    { PicamParameter_SensorTemperatureReading,  "Sensor Temperature Reading",  FloatingPoint, true,  SIM_AMBIENT_TEMP },
+    { PicamParameter_AdcSpeed,                  "ADC Speed",                   FloatingPoint, false, 2.0 },
+    { PicamParameter_TriggerResponse,           "Trigger Response",            Integer,       false, PicamTriggerResponse_NoResponse },
+    { PicamParameter_TriggerDetermination,      "Trigger Determination",       Integer,       false, PicamTriggerDetermination_PositivePolarity },
+    { PicamParameter_ReadoutCount,              "Readout Count",               LargeInteger,  false, 1 },
+    { PicamParameter_ReadoutStride,             "Readout Stride",              Integer,       true,  0 },
+    { PicamParameter_FrameSize,                 "Frame Size",                  Integer,       true,  0 },
+    { PicamParameter_ReadoutTimeCalculation,    "Readout Time Calculation",    FloatingPoint, true,  0 },
+    { PicamParameter_ReadoutRateCalculation,    "Readout Rate Calculation",    FloatingPoint, true,  0 },
+    { PicamParameter_TimeStamps,                "Time Stamps",                 Integer,       false, PicamTimeStampsMask_None },
+    { PicamParameter_TimeStampResolution,       "Time Stamp Resolution",       LargeInteger,  true,  1000000 },
+    { PicamParameter_TimeStampBitDepth,         "Time Stamp Bit Depth",        Integer,       true,  64 },
+    { PicamParameter_TrackFrames,               "Track Frames",                Integer,       false, 0 },
+    { PicamParameter_FrameTrackingBitDepth,     "Frame Tracking Bit Depth",    Integer,       true,  64 }
+};
+
+const int parameterCount = sizeof(parameterTable) / sizeof(parameterTable[0]);
+
+const ParameterInfo* FindParameter(PicamParameter parameter)
+{
+    for( int i = 0; i < parameterCount; i++ )
+        if( parameterTable[i].parameter == parameter )
+            return &parameterTable[i];
+    return NULL;
+}
+
+double EnvValue(const char* name, double fallback)
+{
+    const char* value = getenv( name );
+    if( !value || !*value )
+        return fallback;
+    return atof( value );
+}
+
+struct SimCamera
+{
+    PicamCameraID id;
+
+    std::map<PicamParameter, double> values;        // as set by the caller
+    std::map<PicamParameter, double> committed;     // as last committed
+    PicamRoi roi;                                   // PicamParameter_Rois, as set
+    PicamRoi committedRoi;
+
+    double coolingFrom;
+    Clock::time_point coolingStart;
+
+    // synthetic scene
+    std::vector<float> gauss;
+    std::vector<float> envelope;
+    std::vector<float> cos1, sin1, cos2, sin2;
+    std::vector<float> rowSignal, colFringe;        // per binned row / column
+    unsigned long long rng;
+    pi64s frameNumber;
+
+    // acquisition
+    std::mutex lock;
+    std::condition_variable changed;
+    std::thread generator;
+    bool running;                   // generator thread is producing readouts
+    bool active;                    // final status not yet handed to the caller
+    bool stopRequested;
+
+    PicamAcquisitionBuffer userBuffer;
+    std::vector<pibyte> internalBuffer;
+    std::vector<pibyte> acquireBuffer;
+    pibyte* buffer;
+    pi64s capacity;                 // readouts that fit in buffer
+    pi64s target;                   // readouts to acquire, 0 = until stopped
+    pi64s exposed;                  // readouts attempted, including lost ones
+    pi64s produced;
+    pi64s consumed;                 // handed out by Picam_WaitForAcquisitionUpdate
+    pi64s released;                 // no longer referenced by the caller
+    Clock::time_point started;      // time stamps count from here
+    PicamAcquisitionErrorsMask errors;
+};
+
+bool libraryInitialized = false;
+SimCamera* sim = NULL;
+
+// --- scene ---------------------------------------------------------------
+
+unsigned long long NextRandom(SimCamera* c)
+{
+    // xorshift64*
+    c->rng ^= c->rng >> 12;
+    c->rng ^= c->rng << 25;
+    c->rng ^= c->rng >> 27;
+    return c->rng * 2685821657736338717ULL;
+}
+
+void BuildScene(SimCamera* c)
+{
+    c->rng = 0x9E3779B97F4A7C15ULL;
+
+    // Box-Muller into a table; indexing it randomly is plenty for noise
+    c->gauss.resize( SIM_GAUSS_TABLE );
+    for( int i = 0; i < SIM_GAUSS_TABLE; i += 2 )
+    {
+        double u1 = ( (NextRandom(c) >> 11) + 1.0 ) / 9007199254740993.0;
+        double u2 = ( NextRandom(c) >> 11 ) / 9007199254740992.0;
+        double r = sqrt( -2.0 * log(u1) );
+        c->gauss[i]     = (float)( r * cos( 2 * M_PI * u2 ) );
+        c->gauss[i + 1] = (float)( r * sin( 2 * M_PI * u2 ) );
+    }
+
+    // fringes sit in a band centred on the middle rows of the sensor
+    c->envelope.resize( SIM_ROWS );
+    for( int y = 0; y < SIM_ROWS; y++ )
+    {
+        double d = ( y - SIM_ROWS / 2 ) / 25.0;
+        c->envelope[y] = (float)( 30.0 + 12000.0 * exp( -0.5 * d * d ) );
+    }
+
+    double period = EnvValue( "PICAM_SIM_FRINGE_PERIOD", 16.0 );
+    if( period < 2.0 )
+        period = 2.0;
+    c->cos1.resize( SIM_COLS );
+    c->sin1.resize( SIM_COLS );
+    c->cos2.resize( SIM_COLS );
+    c->sin2.resize( SIM_COLS );
+    for( int x = 0; x < SIM_COLS; x++ )
+    {
+        double k1 = 2 * M_PI * x / period;
+        double k2 = 2 * M_PI * x / ( period * 2.6 );
+        c->cos1[x] = (float)cos( k1 );
+        c->sin1[x] = (float)sin( k1 );
+        c->cos2[x] = (float)cos( k2 );
+        c->sin2[x] = (float)sin( k2 );
+    }
+    c->frameNumber = 0;
+}
+
+void Synthesize(SimCamera* c, pi16u* frame)
+{
+    const float readNoise = (float)EnvValue( "PICAM_SIM_READ_NOISE", 6.0 );
+    const float readVariance = readNoise * readNoise;
+    const PicamRoi& roi = c->committedRoi;
+    const int rows = roi.height / roi.y_binning;
+    const int cols = roi.width / roi.x_binning;
+
+    double phase1 = 0.07 * c->frameNumber;
+    double phase2 = 1.0 - 0.03 * c->frameNumber;
+    float cp1 = (float)cos( phase1 ), sp1 = (float)sin( phase1 );
+    float cp2 = (float)cos( phase2 ), sp2 = (float)sin( phase2 );
+
+    // the scene is separable, so a binned pixel is the product of its
+    // summed row envelope and its summed column fringe
+    c->rowSignal.resize( rows );
+    for( int y = 0; y < rows; y++ )
+    {
+        float sum = 0;
+        for( int b = 0; b < roi.y_binning; b++ )
+            sum += c->envelope[roi.y + y * roi.y_binning + b];
+        c->rowSignal[y] = sum;
+    }
+    c->colFringe.resize( cols );
+    for( int x = 0; x < cols; x++ )
+    {
+        float sum = 0;
+        for( int b = 0; b < roi.x_binning; b++ )
+        {
+            int sx = roi.x + x * roi.x_binning + b;
+            sum += 1.0f
+                + 0.6f  * ( c->cos1[sx] * cp1 - c->sin1[sx] * sp1 )
+                + 0.25f * ( c->cos2[sx] * cp2 - c->sin2[sx] * sp2 );
+        }
+        c->colFringe[x] = sum;
+    }
+
+    for( int y = 0; y < rows; y++ )
+    {
+        const float amplitude = c->rowSignal[y];
+        pi16u* row = frame + (size_t)y * cols;
+        for( int x = 0; x < cols; x++ )
+        {
+            float signal = amplitude * c->colFringe[x];
+            float noise = sqrtf( signal + readVariance ) * c->gauss[NextRandom(c) & (SIM_GAUSS_TABLE - 1)];
+            float value = SIM_BIAS + signal + noise + 0.5f;
+            row[x] = value <= 0.0f ? 0 : value >= 65535.0f ? 65535 : (pi16u)value;
+        }
+    }
+    c->frameNumber++;
+}
+
+// --- timing --------------------------------------------------------------
+
+// milliseconds to read out one frame: every sensor row is shifted, but
+// only the binned ROI pixels are digitised
+double ReadoutTime(SimCamera* c)
+{
+    const PicamRoi& roi = c->committedRoi;
+    double adcMHz = c->committed[PicamParameter_AdcSpeed];
+    double pixels = (double)( roi.height / roi.y_binning ) * ( roi.width / roi.x_binning );
+    double rows = roi.height / roi.y_binning;
+    return SIM_ROWS * 0.0032 + rows * 0.01 + pixels / ( adcMHz * 1000.0 );
+}
+
+double ReadoutRate(SimCamera* c)
+{
+    double fps = EnvValue( "PICAM_SIM_FPS", -1.0 );
+    if( fps >= 0.0 )
+        return fps;
+    return 1000.0 / ( c->committed[PicamParameter_ExposureTime] + ReadoutTime(c) );
+}
+
+Clock::duration ReadoutPeriod(SimCamera* c)
+{
+    double fps = ReadoutRate(c);
+    if( fps <= 0.0 )
+        return Clock::duration::zero();
+    return std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( 1.0 / fps ) );
+}
+
+double SensorTemperature(SimCamera* c)
+{
+    double tau = EnvValue( "PICAM_SIM_COOLING_S", 30.0 );
+    double setPoint = c->committed[PicamParameter_SensorTemperatureSetPoint];
+    double t = std::chrono::duration<double>( Clock::now() - c->coolingStart ).count();
+    if( tau <= 0.0 )
+        return setPoint;
+    return setPoint + ( c->coolingFrom - setPoint ) * exp( -t / tau );
+}
+
+piint FrameBytes(SimCamera* c)
+{
+    const PicamRoi& roi = c->committedRoi;
+    return ( roi.height / roi.y_binning ) * ( roi.width / roi.x_binning ) * sizeof(pi16u);
+}
+
+// time stamps and frame tracking that follow the pixels, if enabled
+piint MetadataBytes(SimCamera* c)
+{
+    piint stamps = (piint)c->committed[PicamParameter_TimeStamps];
+    piint bytes = 0;
+    if( stamps & PicamTimeStampsMask_ExposureStarted )
+        bytes += sizeof(pi64s);
+    if( stamps & PicamTimeStampsMask_ExposureEnded )
+        bytes += sizeof(pi64s);
+    if( c->committed[PicamParameter_TrackFrames] )
+        bytes += sizeof(pi64s);
+    return bytes;
+}
+
+piint ReadoutBytes(SimCamera* c)
+{
+    return FrameBytes(c) + MetadataBytes(c);
+}
+
+// Stamp a readout whose exposure ended now, in ticks since origin.
+void WriteMetadata(SimCamera* c, pibyte* readout, Clock::time_point origin, pi64s tracking)
+{
+    const piint stamps = (piint)c->committed[PicamParameter_TimeStamps];
+    const double ticksPerSecond = c->committed[PicamParameter_TimeStampResolution];
+    const Clock::time_point ended = Clock::now();
+    Clock::time_point started = ended - std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double, std::milli>( c->committed[PicamParameter_ExposureTime] ) );
+    if( started < origin )
+        started = origin;
+
+    pibyte* metadata = readout + FrameBytes(c);
+    if( stamps & PicamTimeStampsMask_ExposureStarted )
+    {
+        pi64s ticks = (pi64s)( std::chrono::duration<double>( started - origin ).count() * ticksPerSecond );
+        memcpy( metadata, &ticks, sizeof(ticks) );
+        metadata += sizeof(ticks);
+    }
+    if( stamps & PicamTimeStampsMask_ExposureEnded )
+    {
+        pi64s ticks = (pi64s)( std::chrono::duration<double>( ended - origin ).count() * ticksPerSecond );
+        memcpy( metadata, &ticks, sizeof(ticks) );
+        metadata += sizeof(ticks);
+    }
+    if( c->committed[PicamParameter_TrackFrames] )
+        memcpy( metadata, &tracking, sizeof(tracking) );
+}
+
+// readouts dropped on the way to the host, by PICAM_SIM_DROP_EVERY
+bool DroppedInTransfer(pi64s tracking)
+{
+    pi64s every = (pi64s)EnvValue( "PICAM_SIM_DROP_EVERY", 0.0 );
+    return every > 0 && tracking % every == 0;
+}
+
+bool SameRoi(const PicamRoi& a, const PicamRoi& b)
+{
+    return a.x == b.x && a.width == b.width && a.x_binning == b.x_binning
+        && a.y == b.y && a.height == b.height && a.y_binning == b.y_binning;
+}
+
+bool ValidRoi(const PicamRoi& roi)
+{
+    return roi.x >= 0 && roi.y >= 0 && roi.x_binning >= 1 && roi.y_binning >= 1
+        && roi.width >= roi.x_binning && roi.height >= roi.y_binning
+        && roi.x + roi.width <= SIM_COLS && roi.y + roi.height <= SIM_ROWS;
+}
+
+bool Committed(SimCamera* c)
+{
+    return c->values == c->committed && SameRoi( c->roi, c->committedRoi );
+}
+
+// --- continuous acquisition ----------------------------------------------
+
+void GeneratorLoop(SimCamera* c)
+{
+    const Clock::duration period = ReadoutPeriod(c);
+    const piint stride = ReadoutBytes(c);
+    Clock::time_point next = Clock::now();
+
+    for( ;; )
+    {
+        if( period > Clock::duration::zero() )
+        {
+            next += period;
+            std::this_thread::sleep_until( next );
+        }
+
+        std::unique_lock<std::mutex> guard(c->lock);
+        if( c->stopRequested || ( c->target > 0 && c->exposed >= c->target ) )
+            break;
+        const pi64s tracking = ++c->exposed;
+        if( c->produced - c->released >= c->capacity )
+        {
+            // the caller still holds every slot: this readout is lost
+            c->errors = (PicamAcquisitionErrorsMask)( c->errors | PicamAcquisitionErrorsMask_DataLost );
+            c->frameNumber++;
+            continue;
+        }
+        if( DroppedInTransfer( tracking ) )
+        {
+            c->frameNumber++;
+            continue;
+        }
+        pibyte* slot = c->buffer + ( c->produced % c->capacity ) * stride;
+        guard.unlock();
+
+        Synthesize( c, (pi16u*)slot );
+        WriteMetadata( c, slot, c->started, tracking );
+
+        guard.lock();
+        c->produced++;
+        c->changed.notify_all();
+    }
+
+    std::lock_guard<std::mutex> guard(c->lock);
+    c->running = false;
+    c->changed.notify_all();
+}
+
+void JoinGenerator(SimCamera* c)
+{
+    {
+        std::lock_guard<std::mutex> guard(c->lock);
+        c->stopRequested = true;
+    }
+    if( c->generator.joinable() )
+        c->generator.join();
+}
+
+PicamError CheckHandle(PicamHandle camera)
+{
+    if( !libraryInitialized )
+        return PicamError_LibraryNotInitialized;
+    if( !camera || camera != (PicamHandle)sim )
+        return PicamError_InvalidHandle;
+    return PicamError_None;
+}
+
+PicamError SetValue(PicamHandle camera, PicamParameter parameter, ValueType type, double value)
+{
+    PicamError error = CheckHandle( camera );
+    if( error != PicamError_None )
+        return error;
+    const ParameterInfo* info = FindParameter( parameter );
+    if( !info )
+        return PicamError_ParameterDoesNotExist;
+    if( info->type != type )
+        return PicamError_ParameterHasInvalidValueType;
+    if( info->readOnly )
+        return PicamError_ParameterValueIsReadOnly;
+
+    std::lock_guard<std::mutex> guard(sim->lock);
+    sim->values[parameter] = value;
+    return PicamError_None;
+}
+
+PicamError GetValue(PicamHandle camera, PicamParameter parameter, ValueType type, double* value)
+{
+    PicamError error = CheckHandle( camera );
+    if( error != PicamError_None )
+        return error;
+    if( !value )
+        return PicamError_InvalidPointer;
+    const ParameterInfo* info = FindParameter( parameter );
+    if( !info )
+        return PicamError_ParameterDoesNotExist;
+    if( info->type != type )
+        return PicamError_ParameterHasInvalidValueType;
+
+    std::lock_guard<std::mutex> guard(sim->lock);
+    if( parameter == PicamParameter_SensorTemperatureReading )
+        *value = SensorTemperature( sim );
+    else
+        *value = sim->values[parameter];
+    return PicamError_None;
+}
+
+bool ValidValue(PicamParameter parameter, double value)
+{
+    switch( parameter )
+    {
+    case PicamParameter_ExposureTime:
+        return value >= 0.0;
+    case PicamParameter_AdcSpeed:
+        return value == 0.1 || value == 1.0 || value == 2.0 || value == 4.0;
+    case PicamParameter_SensorTemperatureSetPoint:
+        return value >= -120.0 && value <= SIM_AMBIENT_TEMP;
+    case PicamParameter_ShutterTimingMode:
+        return value >= PicamShutterTimingMode_Normal && value <= PicamShutterTimingMode_OpenBeforeTrigger;
+    case PicamParameter_TriggerResponse:
+        return value >= PicamTriggerResponse_NoResponse && value <= PicamTriggerResponse_StartOnSingleTrigger;
+    case PicamParameter_TriggerDetermination:
+        return value >= PicamTriggerDetermination_PositivePolarity && value <= PicamTriggerDetermination_FallingEdge;
+    case PicamParameter_ReadoutCount:
+        return value >= 0.0;
+    case PicamParameter_TimeStamps:
+        return value >= PicamTimeStampsMask_None
+            && value <= ( PicamTimeStampsMask_ExposureStarted | PicamTimeStampsMask_ExposureEnded );
+    case PicamParameter_TrackFrames:
+        return value == 0.0 || value == 1.0;
+    default:
+        return true;
+    }
+}
+
+// recompute the read-only parameters from the committed state
+void UpdateDerived(SimCamera* c)
+{
+    c->committed[PicamParameter_FrameSize] = FrameBytes(c);
+    c->committed[PicamParameter_ReadoutStride] = ReadoutBytes(c);
+    c->committed[PicamParameter_ReadoutTimeCalculation] = ReadoutTime(c);
+    c->committed[PicamParameter_ReadoutRateCalculation] = ReadoutRate(c);
+    c->values[PicamParameter_FrameSize] = c->committed[PicamParameter_FrameSize];
+    c->values[PicamParameter_ReadoutStride] = c->committed[PicamParameter_ReadoutStride];
+    c->values[PicamParameter_ReadoutTimeCalculation] = c->committed[PicamParameter_ReadoutTimeCalculation];
+    c->values[PicamParameter_ReadoutRateCalculation] = c->committed[PicamParameter_ReadoutRateCalculation];
+}
+
+char* CopyString(const char* s)
+{
+    char* copy = new char[strlen(s) + 1];
+    strcpy( copy, s );
+    return copy;
+}
+
+const char* ErrorName(piint value)
+{
+    switch( value )
+    {
+    case PicamError_None:                         return "None";
+    case PicamError_UnexpectedError:              return "Unexpected Error";
+    case PicamError_UnexpectedNullPointer:        return "Unexpected Null Pointer";
+    case PicamError_InvalidPointer:               return "Invalid Pointer";
+    case PicamError_LibraryNotInitialized:        return "Library Not Initialized";
+    case PicamError_NoCamerasAvailable:           return "No Cameras Available";
+    case PicamError_InvalidHandle:                return "Invalid Handle";
+    case PicamError_InvalidCameraID:              return "Invalid Camera ID";
+    case PicamError_ParameterDoesNotExist:        return "Parameter Does Not Exist";
+    case PicamError_ParameterValueIsReadOnly:     return "Parameter Value Is Read Only";
+    case PicamError_InvalidParameterValue:        return "Invalid Parameter Value";
+    case PicamError_ParameterHasInvalidValueType: return "Parameter Has Invalid Value Type";
+    case PicamError_ParametersNotCommitted:       return "Parameters Not Committed";
+    case PicamError_InvalidAcquisitionBuffer:     return "Invalid Acquisition Buffer";
+    case PicamError_AcquisitionInProgress:        return "Acquisition In Progress";
+    case PicamError_AcquisitionNotInProgress:     return "Acquisition Not In Progress";
+    case PicamError_TimeOutOccurred:              return "Time Out Occurred";
+    case PicamError_CameraAlreadyOpened:          return "Camera Already Opened";
+    default:                                      return "Unknown Error";
+    }
+}
+
+} // namespace
+
+// --- library -------------------------------------------------------------
+
+PicamError Picam_InitializeLibrary( void )
+{
+    libraryInitialized = true;
+    return PicamError_None;
+}
+
+PicamError Picam_UninitializeLibrary( void )
+{
+    if( sim )
+        Picam_CloseCamera( sim );
+    libraryInitialized = false;
+    return PicamError_None;
+}
+
+PicamError Picam_DestroyString( const pichar* s )
+{
+    delete[] s;
+    return PicamError_None;
+}
+
+PicamError Picam_GetEnumerationString( PicamEnumeratedType type, piint value, const pichar** s )
+{
+    if( !s )
+        return PicamError_InvalidPointer;
+
+    const char* name = "Unknown";
+    switch( type )
+    {
+    case PicamEnumeratedType_Error:
+        name = ErrorName( value );
+        break;
+    case PicamEnumeratedType_Model:
+        if( value == PicamModel_Pylon400BRExcelon )
+            name = "PyLoN 400BR eXcelon";
+        break;
+    case PicamEnumeratedType_Parameter:
+        if( const ParameterInfo* info = FindParameter( (PicamParameter)value ) )
+            name = info->name;
+        else if( value == PicamParameter_Rois )
+            name = "Rois";
+        break;
+    case PicamEnumeratedType_ComputerInterface:
+        name = value == PicamComputerInterface_Usb2 ? "USB 2.0" : "Gigabit Ethernet";
+        break;
+    }
+    *s = CopyString( name );
+    return PicamError_None;
+}
+
+// --- cameras -------------------------------------------------------------
+
+PicamError Picam_ConnectDemoCamera( PicamModel model, const pichar* serial_number, PicamCameraID* id )
+{
+    if( !libraryInitialized )
+        return PicamError_LibraryNotInitialized;
+    if( !serial_number || !id )
+        return PicamError_InvalidPointer;
+    if( model != PicamModel_Pylon400BRExcelon )
+        return PicamError_InvalidCameraID;
+
+    memset( id, 0, sizeof(*id) );
+    id->model = model;
+    id->computer_interface = PicamComputerInterface_GigabitEthernet;
+    strncpy( id->sensor_name, "PyLoN 400BR eXcelon (simulated)", PicamStringSize_SensorName - 1 );
+    strncpy( id->serial_number, serial_number, PicamStringSize_SerialNumber - 1 );
+    return PicamError_None;
+}
+
+PicamError Picam_OpenCamera( const PicamCameraID* id, PicamHandle* camera )
+{
+    if( !libraryInitialized )
+        return PicamError_LibraryNotInitialized;
+    if( !id || !camera )
+        return PicamError_InvalidPointer;
+    if( sim )
+        return PicamError_CameraAlreadyOpened;
+
+    sim = new SimCamera;
+    sim->id = *id;
+    for( int i = 0; i < parameterCount; i++ )
+        sim->values[parameterTable[i].parameter] = parameterTable[i].defaultValue;
+    sim->roi.x = 0;
+    sim->roi.width = SIM_COLS;
+    sim->roi.x_binning = 1;
+    sim->roi.y = 0;
+    sim->roi.height = SIM_ROWS;
+    sim->roi.y_binning = 1;
+    sim->committed = sim->values;
+    sim->committedRoi = sim->roi;
+    UpdateDerived( sim );
+    sim->coolingFrom = SIM_AMBIENT_TEMP;
+    sim->coolingStart = Clock::now();
+    BuildScene( sim );
+
+    sim->running = false;
+    sim->active = false;
+    sim->stopRequested = false;
+    sim->userBuffer.memory = NULL;
+    sim->userBuffer.memory_size = 0;
+    sim->buffer = NULL;
+    sim->capacity = 0;
+    sim->target = 0;
+    sim->exposed = sim->produced = sim->consumed = sim->released = 0;
+    sim->errors = PicamAcquisitionErrorsMask_None;
+
+    *camera = sim;
+    return PicamError_None;
+}
+
+PicamError Picam_OpenFirstCamera( PicamHandle* camera )
+{
+    PicamCameraID id;
+    PicamError error = Picam_ConnectDemoCamera( PicamModel_Pylon400BRExcelon, "SIM0001", &id );
+    if( error != PicamError_None )
+        return error;
+    return Picam_OpenCamera( &id, camera );
+}
+
+PicamError Picam_CloseCamera( PicamHandle camera )
+{
+    PicamError error = CheckHandle( camera );
+    if( error != PicamError_None )
+        return error;
+
+    JoinGenerator( sim );
+    delete sim;
+    sim = NULL;
+    return PicamError_None;
+}
+
+PicamError Picam_GetCameraID( PicamHandle camera, PicamCameraID* id )
+{
+    PicamError error = CheckHandle( camera );
+    if( error != PicamError_None )
+        return error;
+    if( !id )
+        return PicamError_InvalidPointer;
+    *id = sim->id;
+    return PicamError_None;
+}
+
+// --- parameters ----------------------------------------------------------
+
+PicamError Picam_GetParameterIntegerValue( PicamHandle camera, PicamParameter parameter, piint* value )
+{
+    double v = 0;
+    PicamError error = GetValue( camera, parameter, Integer, &v );
+    if( error == PicamError_None )
+        *value = (piint)v;
+    return error;
+}
+
+PicamError Picam_SetParameterIntegerValue( PicamHandle camera, PicamParameter parameter, piint value )
+{
+    return SetValue( camera, parameter, Integer, value );
+}
+
+PicamError Picam_GetParameterLargeIntegerValue( PicamHandle camera, PicamParameter parameter, pi64s* value )
+{
+    double v = 0;
+    PicamError error = GetValue( camera, parameter, LargeInteger, &v );
+    if( error == PicamError_None )
+        *value = (pi64s)v;
+    return error;
+}
+
+PicamError Picam_SetParameterLargeIntegerValue( PicamHandle camera, PicamParameter parameter, pi64s value )
+{
+    return SetValue( camera, parameter, LargeInteger, (double)value );
+}
+
+PicamError Picam_GetParameterFloatingPointValue( PicamHandle camera, PicamParameter parameter, piflt* value )
+{
+    return GetValue( camera, parameter, FloatingPoint, value );
+}
+
+PicamError Picam_SetParameterFloatingPointValue( PicamHandle camera, PicamParameter parameter, piflt value )
+{
+    return SetValue( camera, parameter, FloatingPoint, value );
+}
+
+PicamError Picam_ReadParameterFloatingPointValue( PicamHandle camera, PicamParameter parameter, piflt* value )
+{
+    return GetValue( camera, parameter, FloatingPoint, value );
+}
+
+PicamError Picam_GetParameterRoisValue( PicamHandle camera, PicamParameter parameter, const PicamRois** value )
+{
+    PicamError error = CheckHandle( camera );
+    if( error != PicamError_None )
+        return error;
+    if( !value )
+        return PicamError_InvalidPointer;
+    if( parameter != PicamParameter_Rois )
+        return FindParameter( parameter ) ? PicamError_ParameterHasInvalidValueType : PicamError_ParameterDoesNotExist;
+
+    PicamRois* rois = new PicamRois;
+    rois->roi_array = new PicamRoi[1];
+    rois->roi_count = 1;
+    std::lock_guard<std::mutex> guard(sim->lock);
+    rois->roi_array[0] = sim->roi;
+    *value = rois;
+    return PicamError_None;
+}
+
+PicamError Picam_SetParameterRoisValue( PicamHandle camera, PicamParameter parameter, const PicamRois* value )
+{
+    PicamError error = CheckHandle( camera );
+    if( error != PicamError_None )
+        return error;
+    if( !value || !value->roi_array )
+        return PicamError_InvalidPointer;
+    if( parameter != PicamParameter_Rois )
+        return FindParameter( parameter ) ? PicamError_ParameterHasInvalidValueType : PicamError_ParameterDoesNotExist;
+    // the simulated sensor has a single readout region
+    if( value->roi_count != 1 )
+        return PicamError_InvalidParameterValue;
+
+    std::lock_guard<std::mutex> guard(sim->lock);
+    sim->roi = value->roi_array[0];
+    return PicamError_None;
+}
+
+PicamError Picam_DestroyRois( const PicamRois* rois )
+{
+    if( rois )
+    {
+        delete[] rois->roi_array;
+        delete rois;
+    }
+    return PicamError_None;
+}
+
+PicamError Picam_AreParametersCommitted( PicamHandle camera, pibln* committed )
+{
+    PicamError error = CheckHandle( camera );
+    if( error != PicamError_None )
+        return error;
+    if( !committed )
+        return PicamError_InvalidPointer;
+
+    std::lock_guard<std::mutex> guard(sim->lock);
+    *committed = Committed( sim );
+    return PicamError_None;
+}
+
+PicamError Picam_CommitParameters( PicamHandle camera, const PicamParameter** failed_parameters, piint* failed_parameters_count )
+{
+    PicamError error = CheckHandle( camera );
+    if( error != PicamError_None )
+        return error;
+    if( !failed_parameters || !failed_parameters_count )
+        return PicamError_InvalidPointer;
+
+    *failed_parameters = NULL;
+    *failed_parameters_count = 0;
+
+    double commitTime = EnvValue( "PICAM_SIM_COMMIT_MS", 0.0 );
+    if( commitTime > 0.0 )
+        std::this_thread::sleep_for( std::chrono::duration<double, std::milli>( commitTime ) );
+
+    std::lock_guard<std::mutex> guard(sim->lock);
+    if( sim->running )
+        return PicamError_AcquisitionInProgress;
+
+    std::vector<PicamParameter> failed;
+    for( std::map<PicamParameter, double>::iterator it = sim->values.begin(); it != sim->values.end(); ++it )
+        if( !ValidValue( it->first, it->second ) )
+            failed.push_back( it->first );
+    if( !ValidRoi( sim->roi ) )
+        failed.push_back( PicamParameter_Rois );
+
+    if( !failed.empty() )
+    {
+        PicamParameter* list = new PicamParameter[failed.size()];
+        std::copy( failed.begin(), failed.end(), list );
+        *failed_parameters = list;
+        *failed_parameters_count = (piint)failed.size();
+        return PicamError_InvalidParameterValue;
+    }
+
+    if( sim->values[PicamParameter_SensorTemperatureSetPoint] != sim->committed[PicamParameter_SensorTemperatureSetPoint] )
+    {
+        sim->coolingFrom = SensorTemperature( sim );
+        sim->coolingStart = Clock::now();
+    }
+    sim->committed = sim->values;
+    sim->committedRoi = sim->roi;
+    UpdateDerived( sim );
+    return PicamError_None;
+}
+
+PicamError Picam_DestroyParameters( const PicamParameter* parameters )
+{
+    delete[] parameters;
+    return PicamError_None;
+}
+
+// --- acquisition ---------------------------------------------------------
+
+// Picam_Acquire always reads into simulator-owned memory, which stays
+// valid until the next acquisition.
+PicamError Picam_Acquire( PicamHandle camera, pi64s readout_count, piint readout_time_out, PicamAvailableData* available, PicamAcquisitionErrorsMask* errors )
+{
+    PicamError error = CheckHandle( camera );
+    if( error != PicamError_None )
+        return error;
+    if( !available || !errors )
+        return PicamError_InvalidPointer;
+    if( readout_count <= 0 )
+        return PicamError_InvalidParameterValue;
+
+    {
+        std::lock_guard<std::mutex> guard(sim->lock);
+        if( sim->running )
+            return PicamError_AcquisitionInProgress;
+        if( !Committed( sim ) )
+            return PicamError_ParametersNotCommitted;
+    }
+
+    const piint stride = ReadoutBytes(sim);
+    sim->acquireBuffer.resize( (size_t)stride * readout_count );
+
+    const Clock::duration period = ReadoutPeriod( sim );
+    const Clock::time_point start = Clock::now();
+    Clock::time_point next = start;
+    pi64s collected = 0;
+    pi64s tracking = 0;
+
+    while( collected < readout_count )
+    {
+        if( period > Clock::duration::zero() )
+        {
+            next += period;
+            if( readout_time_out >= 0 && next - start > std::chrono::milliseconds( readout_time_out ) )
+            {
+                std::this_thread::sleep_until( start + std::chrono::milliseconds( readout_time_out ) );
+                break;
+            }
+            std::this_thread::sleep_until( next );
+        }
+        if( DroppedInTransfer( ++tracking ) )
+        {
+            sim->frameNumber++;
+            continue;
+        }
+        pibyte* readout = &sim->acquireBuffer[(size_t)collected * stride];
+        Synthesize( sim, (pi16u*)readout );
+        WriteMetadata( sim, readout, start, tracking );
+        collected++;
+    }
+
+    available->initial_readout = collected ? &sim->acquireBuffer[0] : NULL;
+    available->readout_count = collected;
+    *errors = PicamAcquisitionErrorsMask_None;
+    return collected == readout_count ? PicamError_None : PicamError_TimeOutOccurred;
+}
+
+PicamError Picam_SetAcquisitionBuffer( PicamHandle camera, const PicamAcquisitionBuffer* buffer )
+{
+    PicamError error = CheckHandle( camera );
+    if( error != PicamError_None )
+        return error;
+    if( !buffer )
+        return PicamError_InvalidPointer;
+
+    std::lock_guard<std::mutex> guard(sim->lock);
+    if( sim->running )
+        return PicamError_AcquisitionInProgress;
+    if( buffer->memory && buffer->memory_size < ReadoutBytes(sim) )
+        return PicamError_InvalidAcquisitionBuffer;
+
+    sim->userBuffer = *buffer;
+    if( !buffer->memory )
+        sim->userBuffer.memory_size = 0;
+    return PicamError_None;
+}
+
+PicamError Picam_GetAcquisitionBuffer( PicamHandle camera, PicamAcquisitionBuffer* buffer )
+{
+    PicamError error = CheckHandle( camera );
+    if( error != PicamError_None )
+        return error;
+    if( !buffer )
+        return PicamError_InvalidPointer;
+
+    std::lock_guard<std::mutex> guard(sim->lock);
+    *buffer = sim->userBuffer;
+    return PicamError_None;
+}
+
+PicamError Picam_StartAcquisition( PicamHandle camera )
+{
+    PicamError error = CheckHandle( camera );
+    if( error != PicamError_None )
+        return error;
+
+    std::unique_lock<std::mutex> guard(sim->lock);
+    if( sim->running )
+        return PicamError_AcquisitionInProgress;
+    if( !Committed( sim ) )
+        return PicamError_ParametersNotCommitted;
+    guard.unlock();
+    if( sim->generator.joinable() )
+        sim->generator.join();
+    guard.lock();
+
+    const piint stride = ReadoutBytes(sim);
+    if( sim->userBuffer.memory )
+    {
+        sim->buffer = (pibyte*)sim->userBuffer.memory;
+        sim->capacity = sim->userBuffer.memory_size / stride;
+    }
+    else
+    {
+        sim->internalBuffer.resize( (size_t)stride * SIM_INTERNAL_READOUTS );
+        sim->buffer = &sim->internalBuffer[0];
+        sim->capacity = SIM_INTERNAL_READOUTS;
+    }
+
+    sim->target = (pi64s)sim->committed[PicamParameter_ReadoutCount];
+    sim->exposed = sim->produced = sim->consumed = sim->released = 0;
+    sim->errors = PicamAcquisitionErrorsMask_None;
+    sim->started = Clock::now();
+    sim->stopRequested = false;
+    sim->running = true;
+    sim->active = true;
+    sim->generator = std::thread( GeneratorLoop, sim );
+    return PicamError_None;
+}
+
+PicamError Picam_StopAcquisition( PicamHandle camera )
+{
+    PicamError error = CheckHandle( camera );
+    if( error != PicamError_None )
+        return error;
+
+    std::lock_guard<std::mutex> guard(sim->lock);
+    if( !sim->running )
+        return PicamError_AcquisitionNotInProgress;
+    sim->stopRequested = true;
+    return PicamError_None;
+}
+
+PicamError Picam_IsAcquisitionRunning( PicamHandle camera, pibln* running )
+{
+    PicamError error = CheckHandle( camera );
+    if( error != PicamError_None )
+        return error;
+    if( !running )
+        return PicamError_InvalidPointer;
+
+    std::lock_guard<std::mutex> guard(sim->lock);
+    *running = sim->running;
+    return PicamError_None;
+}
+
+PicamError Picam_WaitForAcquisitionUpdate( PicamHandle camera, piint readout_time_out, PicamAvailableData* available, PicamAcquisitionStatus* status )
+{
+    PicamError error = CheckHandle( camera );
+    if( error != PicamError_None )
+        return error;
+    if( !available || !status )
+        return PicamError_InvalidPointer;
+
+    std::unique_lock<std::mutex> guard(sim->lock);
+    if( !sim->active )
+        return PicamError_AcquisitionNotInProgress;
+
+    // readouts returned by the previous call may now be overwritten
+    sim->released = sim->consumed;
+
+    SimCamera* c = sim;
+    bool ready = true;
+    if( readout_time_out < 0 )
+        sim->changed.wait( guard, [c]{ return c->produced > c->consumed || !c->running; } );
+    else
+        ready = sim->changed.wait_for( guard, std::chrono::milliseconds( readout_time_out ),
+                                       [c]{ return c->produced > c->consumed || !c->running; } );
+
+    available->initial_readout = NULL;
+    available->readout_count = 0;
+    status->running = true;
+    status->errors = PicamAcquisitionErrorsMask_None;
+    status->readout_rate = ReadoutRate( sim );
+    if( !ready )
+        return PicamError_TimeOutOccurred;
+
+    // hand out the contiguous run of readouts up to the end of the buffer
+    pi64s slot = sim->consumed % sim->capacity;
+    pi64s count = sim->produced - sim->consumed;
+    if( count > sim->capacity - slot )
+        count = sim->capacity - slot;
+    if( count > 0 )
+    {
+        available->initial_readout = sim->buffer + slot * ReadoutBytes(sim);
+        available->readout_count = count;
+        sim->consumed += count;
+    }
+
+    status->running = sim->running || sim->produced > sim->consumed;
+    status->errors = sim->errors;
+    sim->errors = PicamAcquisitionErrorsMask_None;
+    if( !status->running )
+        sim->active = false;
+    return PicamError_None;
+}
@@ -0,0 +1,219 @@
+/* Offline stand-in for the Princeton Instruments PICam header.
+ *
+ * Declares the subset of the PICam API that SnapImage and FFTimage use,
+ * with the same type, enumerator and function names as the SDK so the
+ * tools compile unchanged against either.  Enumerator values are the
+ * simulator's own; never mix this header with the real libpicam. */
+
+#ifndef PICAM_H
+#define PICAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* basic types */
+typedef int                 piint;
+typedef double              piflt;
+typedef int                 pibln;
+typedef char                pichar;
+typedef unsigned char       pibyte;
+typedef unsigned short      pi16u;
+typedef unsigned int        pi32u;
+typedef long long           pi64s;
+
+typedef void* PicamHandle;
+
+typedef enum PicamError
+{
+    PicamError_None                         =  0,
+    PicamError_UnexpectedError              =  1,
+    PicamError_UnexpectedNullPointer        =  2,
+    PicamError_InvalidPointer               =  3,
+    PicamError_LibraryNotInitialized        =  4,
+    PicamError_NoCamerasAvailable           =  5,
+    PicamError_InvalidHandle                =  6,
+    PicamError_InvalidCameraID              =  7,
+    PicamError_ParameterDoesNotExist        =  8,
+    PicamError_ParameterValueIsReadOnly     =  9,
+    PicamError_InvalidParameterValue        = 10,
+    PicamError_ParameterHasInvalidValueType = 11,
+    PicamError_ParametersNotCommitted       = 12,
+    PicamError_InvalidAcquisitionBuffer     = 13,
+    PicamError_AcquisitionInProgress        = 14,
+    PicamError_AcquisitionNotInProgress     = 15,
+    PicamError_TimeOutOccurred              = 16,
+    PicamError_CameraAlreadyOpened          = 17
+} PicamError;
+
+typedef enum PicamEnumeratedType
+{
+    PicamEnumeratedType_Error                = 1,
+    PicamEnumeratedType_Model                = 2,
+    PicamEnumeratedType_Parameter            = 3,
+    PicamEnumeratedType_ComputerInterface    = 4
+} PicamEnumeratedType;
+
+typedef enum PicamModel
+{
+    PicamModel_Pylon400BRExcelon             = 1
+} PicamModel;
+
+typedef enum PicamComputerInterface
+{
+    PicamComputerInterface_Usb2              = 1,
+    PicamComputerInterface_GigabitEthernet   = 3
+} PicamComputerInterface;
+
+typedef enum PicamStringSize
+{
+    PicamStringSize_SensorName               = 64,
+    PicamStringSize_SerialNumber             = 64
+} PicamStringSize;
+
+typedef struct PicamCameraID
+{
+    PicamModel             model;
+    PicamComputerInterface computer_interface;
+    pichar                 sensor_name[PicamStringSize_SensorName];
+    pichar                 serial_number[PicamStringSize_SerialNumber];
+} PicamCameraID;
+
+typedef enum PicamParameter
+{
+    PicamParameter_ExposureTime                 =  1,
+    PicamParameter_ShutterTimingMode            =  2,
+    PicamParameter_SensorTemperatureSetPoint    =  3,
+    PicamParameter_SensorTemperatureReading     =  4,
+    PicamParameter_AdcSpeed                     =  5,
+    PicamParameter_TriggerResponse              =  6,
+    PicamParameter_TriggerDetermination         =  7,
+    PicamParameter_ReadoutCount                 =  8,
+    PicamParameter_ReadoutStride                =  9,
+    PicamParameter_FrameSize                    = 10,
+    PicamParameter_ReadoutTimeCalculation       = 11,
+    PicamParameter_ReadoutRateCalculation       = 12,
+    PicamParameter_Rois                         = 13,
+    PicamParameter_TimeStamps                   = 14,
+    PicamParameter_TimeStampResolution          = 15,
+    PicamParameter_TimeStampBitDepth            = 16,
+    PicamParameter_TrackFrames                  = 17,
+    PicamParameter_FrameTrackingBitDepth        = 18
+} PicamParameter;
+
+typedef enum PicamTimeStampsMask
+{
+    PicamTimeStampsMask_None            = 0x0,
+    PicamTimeStampsMask_ExposureStarted = 0x1,
+    PicamTimeStampsMask_ExposureEnded   = 0x2
+} PicamTimeStampsMask;
+
+typedef enum PicamTriggerResponse
+{
+    PicamTriggerResponse_NoResponse               = 1,
+    PicamTriggerResponse_ReadoutPerTrigger        = 2,
+    PicamTriggerResponse_ShiftPerTrigger          = 3,
+    PicamTriggerResponse_ExposeDuringTriggerPulse = 4,
+    PicamTriggerResponse_StartOnSingleTrigger     = 5
+} PicamTriggerResponse;
+
+typedef enum PicamTriggerDetermination
+{
+    PicamTriggerDetermination_PositivePolarity = 1,
+    PicamTriggerDetermination_NegativePolarity = 2,
+    PicamTriggerDetermination_RisingEdge       = 3,
+    PicamTriggerDetermination_FallingEdge      = 4
+} PicamTriggerDetermination;
+
+typedef enum PicamShutterTimingMode
+{
+    PicamShutterTimingMode_Normal            = 1,
+    PicamShutterTimingMode_AlwaysClosed      = 2,
+    PicamShutterTimingMode_AlwaysOpen        = 3,
+    PicamShutterTimingMode_OpenBeforeTrigger = 4
+} PicamShutterTimingMode;
+
+typedef struct PicamRoi
+{
+    piint x;
+    piint width;
+    piint x_binning;
+    piint y;
+    piint height;
+    piint y_binning;
+} PicamRoi;
+
+typedef struct PicamRois
+{
+    PicamRoi* roi_array;
+    piint     roi_count;
+} PicamRois;
+
+typedef enum PicamAcquisitionErrorsMask
+{
+    PicamAcquisitionErrorsMask_None           = 0x0,
+    PicamAcquisitionErrorsMask_DataLost       = 0x1,
+    PicamAcquisitionErrorsMask_ConnectionLost = 0x2
+} PicamAcquisitionErrorsMask;
+
+typedef struct PicamAvailableData
+{
+    void* initial_readout;
+    pi64s readout_count;
+} PicamAvailableData;
+
+typedef struct PicamAcquisitionStatus
+{
+    pibln                      running;
+    PicamAcquisitionErrorsMask errors;
+    piflt                      readout_rate;
+} PicamAcquisitionStatus;
+
+typedef struct PicamAcquisitionBuffer
+{
+    void* memory;
+    pi64s memory_size;
+} PicamAcquisitionBuffer;
+
+/* library */
+PicamError Picam_InitializeLibrary( void );
+PicamError Picam_UninitializeLibrary( void );
+PicamError Picam_DestroyString( const pichar* s );
+PicamError Picam_GetEnumerationString( PicamEnumeratedType type, piint value, const pichar** s );
+
+/* cameras */
+PicamError Picam_ConnectDemoCamera( PicamModel model, const pichar* serial_number, PicamCameraID* id );
+PicamError Picam_OpenFirstCamera( PicamHandle* camera );
+PicamError Picam_OpenCamera( const PicamCameraID* id, PicamHandle* camera );
+PicamError Picam_CloseCamera( PicamHandle camera );
+PicamError Picam_GetCameraID( PicamHandle camera, PicamCameraID* id );
+
+/* parameters */
+PicamError Picam_GetParameterIntegerValue( PicamHandle camera, PicamParameter parameter, piint* value );
+PicamError Picam_SetParameterIntegerValue( PicamHandle camera, PicamParameter parameter, piint value );
+PicamError Picam_GetParameterLargeIntegerValue( PicamHandle camera, PicamParameter parameter, pi64s* value );
+PicamError Picam_SetParameterLargeIntegerValue( PicamHandle camera, PicamParameter parameter, pi64s value );
+PicamError Picam_GetParameterFloatingPointValue( PicamHandle camera, PicamParameter parameter, piflt* value );
+PicamError Picam_SetParameterFloatingPointValue( PicamHandle camera, PicamParameter parameter, piflt value );
+PicamError Picam_ReadParameterFloatingPointValue( PicamHandle camera, PicamParameter parameter, piflt* value );
+PicamError Picam_GetParameterRoisValue( PicamHandle camera, PicamParameter parameter, const PicamRois** value );
+PicamError Picam_SetParameterRoisValue( PicamHandle camera, PicamParameter parameter, const PicamRois* value );
+PicamError Picam_DestroyRois( const PicamRois* rois );
+PicamError Picam_AreParametersCommitted( PicamHandle camera, pibln* committed );
+PicamError Picam_CommitParameters( PicamHandle camera, const PicamParameter** failed_parameters, piint* failed_parameters_count );
+PicamError Picam_DestroyParameters( const PicamParameter* parameters );
+
+/* acquisition */
+PicamError Picam_Acquire( PicamHandle camera, pi64s readout_count, piint readout_time_out, PicamAvailableData* available, PicamAcquisitionErrorsMask* errors );
+PicamError Picam_SetAcquisitionBuffer( PicamHandle camera, const PicamAcquisitionBuffer* buffer );
+PicamError Picam_GetAcquisitionBuffer( PicamHandle camera, PicamAcquisitionBuffer* buffer );
+PicamError Picam_StartAcquisition( PicamHandle camera );
+PicamError Picam_StopAcquisition( PicamHandle camera );
+PicamError Picam_IsAcquisitionRunning( PicamHandle camera, pibln* running );
+PicamError Picam_WaitForAcquisitionUpdate( PicamHandle camera, piint readout_time_out, PicamAvailableData* available, PicamAcquisitionStatus* status );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
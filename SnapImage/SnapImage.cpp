@@ -9,21 +9,21 @@
 
 #include "stdio.h"
 #include "picam.h"
+#include "SensorGeometry.h"
+#include "LivePreview.h"
+#include "CameraParameters.h"
+#include "ReadoutBatch.h"
 #include <opencv2/opencv.hpp>
 
 using namespace cv;
 
 //TODO: put these Print functions into another file
 
-void PrintData( pibyte* buf, piint numframes, piint framelength )
+void PrintData( const ReadoutBatch& batch, const FrameGeometry& geometry )
 {
-    pi16u  *midpt = NULL;
-    pibyte *frameptr = NULL;
-
-    for( piint loop = 0; loop < numframes; loop++ )
+    for( int loop = 0; loop < batch.Count(); loop++ )
     {
-        frameptr = buf + ( framelength * loop );
-        midpt = (pi16u*)frameptr + ( ( ( framelength/sizeof(pi16u) )/ 2 ) );
+        const pi16u* midpt = batch.Frame( loop ) + ( geometry.rows * geometry.cols ) / 2;
         printf( "%5d,%5d,%5d\t%d\n", *(midpt-1), *(midpt), *(midpt+1), loop+1 );
     }
 }
@@ -49,71 +49,44 @@ void PrintError (PicamError error)
     }
 }
 
-void ConfigureCamera (PicamHandle camera)
+// Only settings that differ from what the camera already has are sent,
+// and the commit is skipped when nothing changed.
+void ConfigureCamera (CameraParameters& parameters)
 {
     std::cout << "Set ADC rate to 4 MHz: ";
 
     PicamError error;
-    error = Picam_SetParameterFloatingPointValue(
-                camera,
+    error = parameters.SetFloatingPoint(
                 PicamParameter_AdcSpeed,
                 4.0 );
     PrintError( error );
 
-    error = Picam_SetParameterFloatingPointValue(
-                camera,
+    error = parameters.SetFloatingPoint(
                 PicamParameter_SensorTemperatureSetPoint,
                 -120 );
     PrintError ( error );
 
-    error = Picam_SetParameterIntegerValue(
-                camera,
+    error = parameters.SetInteger(
                 PicamParameter_TriggerResponse,
                 PicamTriggerResponse_ExposeDuringTriggerPulse );
     PrintError ( error );
 
-    error = Picam_SetParameterIntegerValue(
-                camera,
+    error = parameters.SetInteger(
                 PicamParameter_ShutterTimingMode,
                 PicamShutterTimingMode_AlwaysOpen );
     PrintError ( error );
 
+    // apply changes to hardware, if there are any
+    if( !parameters.Commit( true ) )
+        std::cout << "Commit to hardware failed\n";
+}
 
-
-    pibln committed;
-    Picam_AreParametersCommitted( camera, &committed );
-    if( committed )
-        std::cout << "Parameters have not changed" << std::endl;
-    else
-        std::cout << "Parameters have been modified" << std::endl;
-
-    // apply changes to hardware
-    std::cout << "Commit to hardware: ";
-    const PicamParameter* failed_parameters;
-    piint failed_parameters_count;
-    error =
-        Picam_CommitParameters(
-            camera,
-            &failed_parameters,
-            &failed_parameters_count );
-    PrintError( error );
-
-    std::cout << "Testing for invalid params\n";
-    if( failed_parameters_count > 0 )
-    {
-        std::cout << "The following params are invalid:" << std::endl;
-        for( piint i = 0; i < failed_parameters_count; ++i )
-        {
-            std::cout << "    ";
-            PrintEnumString(
-                PicamEnumeratedType_Parameter,
-                failed_parameters[i] );
-            std::cout << std::endl;
-        }
-    }
-    std::cout << "Cleaning up resources\n";
-
-    Picam_DestroyParameters( failed_parameters );
+// Put frame n up (never dropped by the rate limit) and wait for a key.
+void ShowFrame( LivePreview& preview, const ReadoutBatch& batch, const FrameGeometry& geometry, int n )
+{
+    preview.Offer( Mat(geometry.rows, geometry.cols, CV_16U, (void*)batch.Frame( n )), true );
+    printf( "Press a key in the preview window to continue\n" );
+    preview.WaitForKey();
 }
 
 int main()
@@ -124,10 +97,6 @@ int main()
     PicamHandle camera;
     PicamCameraID id;
     const pichar* string;
-    PicamAvailableData data;
-    PicamAcquisitionErrorsMask errors;
-
-    piint readoutstride = 0;
 
     if( Picam_OpenFirstCamera( &camera ) == PicamError_None )
         Picam_GetCameraID( camera, &id );
@@ -145,46 +114,51 @@ int main()
     printf( " (SN:%s) [%s]\n", id.serial_number, id.sensor_name );
     Picam_DestroyString( string );
 
-    ConfigureCamera( camera );
+    CameraParameters parameters( camera );
+    ConfigureCamera( parameters );
 
-    Picam_GetParameterIntegerValue( camera, PicamParameter_ReadoutStride, &readoutstride );
+    // frame size follows whatever ROI and binning the camera has committed
+    FrameGeometry geometry;
+    if( !GetFrameGeometry( camera, &geometry ) )
+    {
+        printf( "Cannot read the frame geometry\n" );
+        Picam_CloseCamera( camera );
+        Picam_UninitializeLibrary();
+        return 1;
+    }
+
+    LivePreview preview( "DisplayImage", 20, 800 );
+    preview.Start();
+
+    // readouts are wrapped in place; they stay valid until the next Picam_Acquire
+    ReadoutBatch batch( geometry );
 
     //collect one frame
     printf( "\n\n" );
     printf( "Collecting 1 frame\n\n" );
-    if( Picam_Acquire( camera, 1, NO_TIMEOUT, &data, &errors ) )
-        printf( "Error: Camera only collected %d frames\n", (piint)data.readout_count );
-    else
-    {
-        PrintData( (pibyte*)data.initial_readout, 1, readoutstride );
-    }
-
-    Mat image = Mat(400,1340, CV_16U, data.initial_readout).clone();
+    if( batch.Acquire( camera, 1, NO_TIMEOUT ) )
+        PrintData( batch, geometry );
 
     printf( "Display data\n" );
 
-    namedWindow( "DisplayImage", CV_WINDOW_AUTOSIZE );
-    imshow( "DisplayImage", image );
+    // the preview copies the frame and draws it on its own thread; each
+    // frame stays up until a key is pressed in its window
+    if( batch.Count() > 0 )
+        ShowFrame( preview, batch, geometry, 0 );
 
-    waitKey(0);
-
-    //collect two frames
+    //collect two frames in one call
     printf( "\n\n" );
     printf( "Collecting 2 frames\n\n" );
-    if( Picam_Acquire( camera, 2, NO_TIMEOUT, &data, &errors ) )
-        printf( "Error: Camera only collected %d frames\n", (piint)data.readout_count );
-    else
-    {
-        PrintData( (pibyte*)data.initial_readout, 1, readoutstride );
-    }
-
-    Mat image2 = Mat(400,1340, CV_16U, data.initial_readout).clone();
+    if( batch.Acquire( camera, 2, NO_TIMEOUT ) )
+        PrintData( batch, geometry );
 
     printf( "Display data\n" );
 
-    namedWindow( "DisplayImage", CV_WINDOW_AUTOSIZE );
-    imshow( "DisplayImage", image2 );
+    for( int n = 0; n < batch.Count(); n++ )
+        ShowFrame( preview, batch, geometry, n );
 
     Picam_CloseCamera( camera );
     Picam_UninitializeLibrary();
+
+    preview.Stop();
 }